@@ -0,0 +1,274 @@
+
+#ifndef EVENTVIEW_BULKREPLAY_H
+#define EVENTVIEW_BULKREPLAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+#include "entitystorage.h"
+#include "filelog.h"
+
+namespace eventview {
+
+    struct BulkReplayResult {
+        std::size_t events = 0;
+        //the newest EventID loaded
+        EventID latest = 0;
+        //every entity that had events of its own, as opposed to stubs only referenced
+        std::vector<EntityDescriptor> entities{};
+    };
+
+    /*
+     * Rebuilds an EntityStore from log chunks without going through the publisher. Chunks are decoded in
+     * parallel and each event is folded as soon as it is decoded into its entity's record in one of the shards
+     * partitioned by EntityID, so only the newest version of an entity is held rather than its whole history. Each
+     * shard then builds its own store, and a final parallel pass partitioned by referenced id rebuilds the reverse
+     * refs. The result is what publishing the events in EventID order would give, which for LWW state is the
+     * newest event of each entity.
+     */
+    class BulkReplay final {
+    public:
+        explicit BulkReplay(std::size_t threads) : shards_{std::max<std::size_t>(1, threads)} {}
+
+        inline BulkReplayResult run(const std::vector<LogPosition> &chunks, EntityStore &store) const;
+
+    private:
+        struct EdgeOp {
+            EntityDescriptor target;
+            std::string field;
+            EntityDescriptor referencer;
+            EventID time;
+            bool add;
+        };
+
+        /*
+         * What replaying an entity's versions in EventID order leaves behind, folded from them in any order. Refs
+         * add and remove with the newest time of each, so a ref only needs the last version that held it: it was
+         * removed by the version after that one, if there is any.
+         */
+        struct Folded {
+            Event newest{};
+            std::vector<EventID> versions{};
+            std::vector<EdgeOp> last_held{};
+        };
+
+        using FoldedShard = std::unordered_map<EntityID, Folded>;
+
+        inline static void fold(Event &&evt, FoldedShard &shard);
+
+        inline static void fold(Folded &&from, Folded &into);
+
+        inline static void held(const EdgeOp &ref, Folded &into);
+
+        //snowflake low bits are mostly writer and sequence, so ids are mixed before picking a shard
+        std::size_t shard_of(EntityID id) const {
+            return static_cast<std::size_t>((id * 0x9E3779B97F4A7C15ull) >> 32u) % shards_;
+        }
+
+        template<typename Work>
+        void in_parallel(Work &&work) const;
+
+        inline std::size_t apply_entities(FoldedShard &folded, EntityStore &shard,
+                                          std::vector<std::vector<EdgeOp>> &edges,
+                                          std::vector<EntityDescriptor> &entities) const;
+
+        inline static void apply_edges(std::vector<std::vector<EdgeOp>> &ops, EntityStore &shard);
+
+        std::size_t shards_;
+    };
+
+    template<typename Work>
+    void BulkReplay::in_parallel(Work &&work) const {
+        std::vector<std::exception_ptr> failures(shards_);
+        auto run = [&](std::size_t part) {
+            try {
+                work(part);
+            } catch (...) {
+                failures[part] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> pool{};
+        try {
+            for (std::size_t part = 1; part < shards_; ++part) {
+                pool.emplace_back(run, part);
+            }
+        } catch (...) {
+            //a thread that failed to start must not leave the started ones joinable, which would terminate
+            for (auto &thread : pool) {
+                thread.join();
+            }
+            throw;
+        }
+        run(0);
+        for (auto &thread : pool) {
+            thread.join();
+        }
+
+        for (auto &failure : failures) {
+            if (failure) {
+                std::rethrow_exception(failure);
+            }
+        }
+    }
+
+    inline BulkReplayResult BulkReplay::run(const std::vector<LogPosition> &chunks, EntityStore &store) const {
+        //decode: threads take chunks in turn and fold each event into its entity's record in its shard
+        std::vector<std::vector<FoldedShard>> routed(shards_, std::vector<FoldedShard>(shards_));
+        std::vector<EventID> latest(shards_, 0);
+        std::atomic<std::size_t> next_chunk{0};
+        in_parallel([&](std::size_t part) {
+            auto &out = routed[part];
+            Event evt{};
+            for (auto chunk = next_chunk++; chunk < chunks.size(); chunk = next_chunk++) {
+                LogReader reader{chunks[chunk]};
+                while (reader.next(evt)) {
+                    latest[part] = std::max(latest[part], evt.id);
+                    auto shard = shard_of(evt.entity.descriptor().id);
+                    fold(std::move(evt), out[shard]);
+                }
+            }
+        });
+
+        //entities: each shard settles the fields of its own entities and emits the edge changes they made
+        std::vector<EntityStore> stores(shards_);
+        std::vector<std::vector<std::vector<EdgeOp>>> edges(shards_, std::vector<std::vector<EdgeOp>>(shards_));
+        std::vector<std::vector<EntityDescriptor>> entities(shards_);
+        std::vector<std::size_t> applied(shards_, 0);
+        in_parallel([&](std::size_t shard) {
+            FoldedShard folded{};
+            for (auto &from : routed) {
+                for (auto &kv : from[shard]) {
+                    fold(std::move(kv.second), folded[kv.first]);
+                }
+                FoldedShard{}.swap(from[shard]);
+            }
+            applied[shard] = apply_entities(folded, stores[shard], edges[shard], entities[shard]);
+        });
+
+        //edges: each shard applies the changes to the reverse refs of the entities it holds
+        in_parallel([&](std::size_t shard) {
+            std::vector<std::vector<EdgeOp>> ops{};
+            for (auto &from : edges) {
+                ops.push_back(std::move(from[shard]));
+            }
+            apply_edges(ops, stores[shard]);
+        });
+
+        BulkReplayResult result{};
+        for (std::size_t shard = 0; shard < shards_; ++shard) {
+            store.merge(std::move(stores[shard]));
+            result.events += applied[shard];
+            result.latest = std::max(result.latest, latest[shard]);
+            result.entities.insert(result.entities.end(), entities[shard].begin(), entities[shard].end());
+        }
+        return result;
+    }
+
+    inline void BulkReplay::fold(Event &&evt, FoldedShard &shard) {
+        auto &into = shard[evt.entity.descriptor().id];
+        into.versions.push_back(evt.id);
+
+        auto &referencer = evt.entity.descriptor();
+        for (auto &kv : evt.entity.fields()) {
+            if (kv.second.is_descriptor()) {
+                held(EdgeOp{kv.second.as_descriptor(), kv.first, referencer, evt.id, true}, into);
+            }
+        }
+
+        //of versions logged twice under one id by a retried append, the first is kept
+        if (into.versions.size() == 1 || evt.id > into.newest.id) {
+            into.newest = std::move(evt);
+        }
+    }
+
+    inline void BulkReplay::fold(Folded &&from, Folded &into) {
+        if (into.versions.empty()) {
+            into = std::move(from);
+            return;
+        }
+
+        into.versions.insert(into.versions.end(), from.versions.begin(), from.versions.end());
+        for (auto &ref : from.last_held) {
+            held(ref, into);
+        }
+        if (from.newest.id > into.newest.id) {
+            into.newest = std::move(from.newest);
+        }
+    }
+
+    inline void BulkReplay::held(const EdgeOp &ref, Folded &into) {
+        for (auto &known : into.last_held) {
+            if (known.field == ref.field && known.target == ref.target) {
+                known.time = std::max(known.time, ref.time);
+                return;
+            }
+        }
+        into.last_held.push_back(ref);
+    }
+
+    inline std::size_t BulkReplay::apply_entities(FoldedShard &folded, EntityStore &shard,
+                                                  std::vector<std::vector<EdgeOp>> &edges,
+                                                  std::vector<EntityDescriptor> &entities) const {
+        std::size_t applied = 0;
+        for (auto &kv : folded) {
+            auto &entity = kv.second;
+            auto &versions = entity.versions;
+            std::sort(versions.begin(), versions.end());
+            versions.erase(std::unique(versions.begin(), versions.end()), versions.end());
+            applied += versions.size();
+
+            for (auto &ref : entity.last_held) {
+                auto &by_target = edges[shard_of(ref.target.id)];
+                by_target.push_back(ref);
+                auto dropped = std::upper_bound(versions.begin(), versions.end(), ref.time);
+                if (dropped != versions.end()) {
+                    by_target.push_back(EdgeOp{ref.target, ref.field, ref.referencer, *dropped, false});
+                }
+            }
+
+            if (kv.first != 0) {
+                entities.push_back(entity.newest.entity.descriptor());
+                shard.put(entity.newest.id, std::move(entity.newest.entity));
+            }
+            entity = Folded{};
+        }
+
+        FoldedShard{}.swap(folded);
+        return applied;
+    }
+
+    inline void BulkReplay::apply_edges(std::vector<std::vector<EdgeOp>> &ops, EntityStore &shard) {
+        //adds and removes keep the newest time of each, so the order they are applied in doesn't matter
+        for (auto &from : ops) {
+            for (auto &op : from) {
+                auto node = shard.get(op.target);
+                if (!node) {
+                    //same stub the publisher makes for an entity referenced before it is written
+                    shard.put(1, Entity{op.target});
+                    node = shard.get(op.target);
+                    if (!node) {
+                        //the id is held by an entity of another type
+                        continue;
+                    }
+                }
+
+                if (op.add) {
+                    node->get().add_referencer(op.time, op.field, op.referencer);
+                } else {
+                    node->get().remove_referencer(op.time, op.field, op.referencer);
+                }
+            }
+            std::vector<EdgeOp>{}.swap(from);
+        }
+    }
+
+}
+
+#endif //EVENTVIEW_BULKREPLAY_H
@@ -0,0 +1,507 @@
+
+#ifndef EVENTVIEW_CODEC_H
+#define EVENTVIEW_CODEC_H
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+namespace eventview {
+
+    namespace codec {
+
+        inline void put_varint(std::string &out, std::uint64_t value) {
+            while (value >= 0x80u) {
+                out.push_back(static_cast<char>(value | 0x80u));
+                value >>= 7u;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        //maps signed deltas to small unsigned values, so ids a little before the previous one stay short
+        inline std::uint64_t zigzag(std::int64_t value) {
+            return (static_cast<std::uint64_t>(value) << 1u) ^ static_cast<std::uint64_t>(value >> 63);
+        }
+
+        inline std::int64_t unzigzag(std::uint64_t value) {
+            return static_cast<std::int64_t>(value >> 1u) ^ -static_cast<std::int64_t>(value & 1u);
+        }
+
+        inline std::uint64_t delta(std::uint64_t value, std::uint64_t base) {
+            return zigzag(static_cast<std::int64_t>(value - base));
+        }
+
+        inline std::uint64_t undelta(std::uint64_t encoded, std::uint64_t base) {
+            return base + static_cast<std::uint64_t>(unzigzag(encoded));
+        }
+
+        //bounds checked cursor over encoded bytes
+        struct Reader {
+            const char *pos;
+            const char *end;
+
+            std::uint64_t varint() {
+                std::uint64_t value = 0;
+                for (unsigned shift = 0; shift < 64; shift += 7) {
+                    auto byte = static_cast<std::uint8_t>(next(1)[0]);
+                    value |= static_cast<std::uint64_t>(byte & 0x7fu) << shift;
+                    if ((byte & 0x80u) == 0) {
+                        return value;
+                    }
+                }
+                throw std::runtime_error{"malformed varint in event record"};
+            }
+
+            std::uint8_t byte() {
+                return static_cast<std::uint8_t>(next(1)[0]);
+            }
+
+            std::double_t real() {
+                std::double_t value;
+                std::memcpy(&value, next(sizeof(value)), sizeof(value));
+                return value;
+            }
+
+            std::string_view bytes() {
+                auto len = varint();
+                return std::string_view{next(len), static_cast<std::size_t>(len)};
+            }
+
+            const char *next(std::uint64_t len) {
+                if (static_cast<std::uint64_t>(end - pos) < len) {
+                    throw std::runtime_error{"truncated event record"};
+                }
+                auto at = pos;
+                pos += len;
+                return at;
+            }
+        };
+
+        enum class FieldTag : std::uint8_t {
+            Long,
+            Double,
+            String,
+            False,
+            True,
+            Descriptor
+        };
+
+    }
+
+    /*
+     * Field names seen so far by an encoder or decoder, numbered in first-seen order. A name's first occurrence is
+     * written inline and every later one as its number, so both sides build the same dictionary from the stream.
+     */
+    class FieldDictionary final {
+    public:
+        std::optional<std::uint32_t> find(const std::string &name) const {
+            auto found = ids_.find(name);
+            if (found == ids_.end()) {
+                return {};
+            }
+            return found->second;
+        }
+
+        std::uint32_t add(std::string name) {
+            auto id = static_cast<std::uint32_t>(names_.size());
+            names_.push_back(std::move(name));
+            ids_.emplace(names_.back(), id);
+            return id;
+        }
+
+        //stable for the dictionary's lifetime; names are never moved once added
+        const std::string &name(std::uint32_t id) const {
+            if (id >= names_.size()) {
+                throw std::runtime_error{"unknown field name in event record"};
+            }
+            return names_[id];
+        }
+
+        std::size_t size() const {
+            return names_.size();
+        }
+
+        void clear() {
+            names_.clear();
+            ids_.clear();
+        }
+
+    private:
+        std::deque<std::string> names_;
+        std::unordered_map<std::string, std::uint32_t> ids_;
+    };
+
+    //one field of an EncodedEvent, read in place; string values point into the encoded bytes
+    class EncodedField final {
+    public:
+        EncodedField(std::string_view name, codec::FieldTag tag, std::uint64_t bits, std::uint64_t type,
+                     std::string_view str) : name_{name}, tag_{tag}, bits_{bits}, type_{type}, str_{str} {}
+
+        std::string_view name() const {
+            return name_;
+        }
+
+        bool is_long() const {
+            return tag_ == codec::FieldTag::Long;
+        }
+
+        std::uint64_t as_long() const {
+            return bits_;
+        }
+
+        bool is_double() const {
+            return tag_ == codec::FieldTag::Double;
+        }
+
+        std::double_t as_double() const {
+            std::double_t value;
+            std::memcpy(&value, &bits_, sizeof(value));
+            return value;
+        }
+
+        bool is_string() const {
+            return tag_ == codec::FieldTag::String;
+        }
+
+        std::string_view as_string() const {
+            return str_;
+        }
+
+        bool is_bool() const {
+            return tag_ == codec::FieldTag::False || tag_ == codec::FieldTag::True;
+        }
+
+        bool as_bool() const {
+            return tag_ == codec::FieldTag::True;
+        }
+
+        bool is_descriptor() const {
+            return tag_ == codec::FieldTag::Descriptor;
+        }
+
+        EntityDescriptor as_descriptor() const {
+            return EntityDescriptor{bits_, type_};
+        }
+
+        inline PrimitiveFieldValue value() const;
+
+    private:
+        std::string_view name_;
+        codec::FieldTag tag_;
+        std::uint64_t bits_;
+        std::uint64_t type_;
+        std::string_view str_;
+    };
+
+    inline PrimitiveFieldValue EncodedField::value() const {
+        switch (tag_) {
+            case codec::FieldTag::Long:
+                return {as_long()};
+            case codec::FieldTag::Double:
+                return {as_double()};
+            case codec::FieldTag::String:
+                return {std::string{str_}};
+            case codec::FieldTag::Descriptor:
+                return {as_descriptor()};
+            default:
+                return {as_bool()};
+        }
+    }
+
+    /*
+     * An event read in place from its encoded bytes, which must outlive it along with the decoder's dictionary.
+     * Fields are parsed on each visit rather than collected into an Entity, so a reader after a few fields of a
+     * large event never builds its field map.
+     */
+    class EncodedEvent final {
+    public:
+        EncodedEvent(EventID id, EntityDescriptor descriptor, std::uint64_t field_count, const char *fields,
+                     const char *end, const FieldDictionary *dictionary) :
+                id_{id}, descriptor_{descriptor}, field_count_{field_count}, fields_{fields}, end_{end},
+                dictionary_{dictionary} {}
+
+        EventID id() const {
+            return id_;
+        }
+
+        const EntityDescriptor &descriptor() const {
+            return descriptor_;
+        }
+
+        std::size_t field_count() const {
+            return field_count_;
+        }
+
+        template<typename Visitor>
+        void visit_fields(Visitor &&visitor) const {
+            codec::Reader in{fields_, end_};
+            for (std::uint64_t i = 0; i < field_count_; ++i) {
+                visitor(read_field(in));
+            }
+        }
+
+        inline std::optional<EncodedField> find(std::string_view name) const;
+
+        inline Event to_event() const;
+
+    private:
+        inline EncodedField read_field(codec::Reader &in) const;
+
+        EventID id_;
+        EntityDescriptor descriptor_;
+        std::uint64_t field_count_;
+        const char *fields_;
+        const char *end_;
+        const FieldDictionary *dictionary_;
+    };
+
+    inline EncodedField EncodedEvent::read_field(codec::Reader &in) const {
+        auto code = in.varint();
+        std::string_view name{};
+        if (code == 0) {
+            name = in.bytes();
+        } else {
+            name = dictionary_->name(static_cast<std::uint32_t>(code - 1));
+        }
+
+        auto tag = static_cast<codec::FieldTag>(in.byte());
+        switch (tag) {
+            case codec::FieldTag::Long:
+                return EncodedField{name, tag, in.varint(), 0, {}};
+            case codec::FieldTag::Double: {
+                auto value = in.real();
+                std::uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                return EncodedField{name, tag, bits, 0, {}};
+            }
+            case codec::FieldTag::String:
+                return EncodedField{name, tag, 0, 0, in.bytes()};
+            case codec::FieldTag::False:
+            case codec::FieldTag::True:
+                return EncodedField{name, tag, 0, 0, {}};
+            case codec::FieldTag::Descriptor: {
+                auto ref_id = codec::undelta(in.varint(), id_);
+                return EncodedField{name, tag, ref_id, in.varint(), {}};
+            }
+            default:
+                throw std::runtime_error{"unknown field value in event record"};
+        }
+    }
+
+    inline std::optional<EncodedField> EncodedEvent::find(std::string_view name) const {
+        codec::Reader in{fields_, end_};
+        for (std::uint64_t i = 0; i < field_count_; ++i) {
+            auto field = read_field(in);
+            if (field.name() == name) {
+                return field;
+            }
+        }
+        return {};
+    }
+
+    inline Event EncodedEvent::to_event() const {
+        Event evt{};
+        evt.id = id_;
+        evt.entity = Entity{descriptor_};
+        visit_fields([&](const EncodedField &field) {
+            evt.entity.set_field(std::string{field.name()}, field.value());
+        });
+        return evt;
+    }
+
+    /*
+     * Encodes a stream of events. Event ids are written as zigzag deltas from the previous event, entity and
+     * referenced ids as deltas from their own event, integers as varints, and field names through a dictionary.
+     * Decoding needs the same stream from its start, or from the last reset on both sides.
+     */
+    class EventEncoder final {
+    public:
+        EventEncoder() = default;
+
+        //continues a stream where a decoder that read it so far left off
+        EventEncoder(FieldDictionary dictionary, EventID last_id) : dictionary_{std::move(dictionary)},
+                                                                    last_id_{last_id} {}
+
+        inline void encode(const Event &evt, std::string &out);
+
+        std::string encode(const Event &evt) {
+            std::string out{};
+            encode(evt, out);
+            return out;
+        }
+
+        void reset() {
+            dictionary_.clear();
+            last_id_ = 0;
+        }
+
+    private:
+        FieldDictionary dictionary_{};
+        EventID last_id_{0};
+    };
+
+    inline void EventEncoder::encode(const Event &evt, std::string &out) {
+        auto &desc = evt.entity.descriptor();
+        codec::put_varint(out, codec::delta(evt.id, last_id_));
+        codec::put_varint(out, codec::delta(desc.id, evt.id));
+        codec::put_varint(out, desc.type);
+        codec::put_varint(out, evt.entity.fields().size());
+        last_id_ = evt.id;
+
+        for (auto &kv : evt.entity.fields()) {
+            auto code = dictionary_.find(kv.first);
+            if (code) {
+                codec::put_varint(out, *code + 1u);
+            } else {
+                dictionary_.add(kv.first);
+                codec::put_varint(out, 0);
+                codec::put_varint(out, kv.first.size());
+                out.append(kv.first);
+            }
+
+            auto &val = kv.second;
+            if (val.is_long()) {
+                out.push_back(static_cast<char>(codec::FieldTag::Long));
+                codec::put_varint(out, val.as_long());
+            } else if (val.is_double()) {
+                out.push_back(static_cast<char>(codec::FieldTag::Double));
+                auto value = val.as_double();
+                out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+            } else if (val.is_string()) {
+                out.push_back(static_cast<char>(codec::FieldTag::String));
+                codec::put_varint(out, val.as_string().size());
+                out.append(val.as_string());
+            } else if (val.is_descriptor()) {
+                out.push_back(static_cast<char>(codec::FieldTag::Descriptor));
+                codec::put_varint(out, codec::delta(val.as_descriptor().id, evt.id));
+                codec::put_varint(out, val.as_descriptor().type);
+            } else {
+                auto flag = std::get<bool>(val.val) ? codec::FieldTag::True : codec::FieldTag::False;
+                out.push_back(static_cast<char>(flag));
+            }
+        }
+    }
+
+    //the decoding side of an EventEncoder's stream
+    class EventDecoder final {
+    public:
+        /*
+         * Reads the event starting at pos and advances pos past it. The returned view refers to the bytes and to
+         * this decoder's dictionary.
+         */
+        inline EncodedEvent next(const char *&pos, const char *end);
+
+        Event decode(const char *&pos, const char *end) {
+            return next(pos, end).to_event();
+        }
+
+        Event decode(const std::string &record) {
+            auto pos = record.data();
+            return decode(pos, record.data() + record.size());
+        }
+
+        const FieldDictionary &dictionary() const {
+            return dictionary_;
+        }
+
+        EventID last_id() const {
+            return last_id_;
+        }
+
+        void reset() {
+            dictionary_.clear();
+            last_id_ = 0;
+        }
+
+    private:
+        FieldDictionary dictionary_{};
+        EventID last_id_{0};
+    };
+
+    inline EncodedEvent EventDecoder::next(const char *&pos, const char *end) {
+        codec::Reader in{pos, end};
+        auto id = codec::undelta(in.varint(), last_id_);
+        auto entity_id = codec::undelta(in.varint(), id);
+        auto type = in.varint();
+        auto count = in.varint();
+        auto fields = in.pos;
+
+        //walks the fields once to find the event's end and learn the names it introduces
+        std::vector<std::string_view> introduced{};
+        for (std::uint64_t i = 0; i < count; ++i) {
+            auto code = in.varint();
+            if (code == 0) {
+                introduced.push_back(in.bytes());
+            } else if (code > dictionary_.size() + introduced.size()) {
+                throw std::runtime_error{"unknown field name in event record"};
+            }
+
+            switch (static_cast<codec::FieldTag>(in.byte())) {
+                case codec::FieldTag::Long:
+                    in.varint();
+                    break;
+                case codec::FieldTag::Double:
+                    in.real();
+                    break;
+                case codec::FieldTag::String:
+                    in.bytes();
+                    break;
+                case codec::FieldTag::False:
+                case codec::FieldTag::True:
+                    break;
+                case codec::FieldTag::Descriptor:
+                    in.varint();
+                    in.varint();
+                    break;
+                default:
+                    throw std::runtime_error{"unknown field value in event record"};
+            }
+        }
+
+        //only a record that parsed in full changes the decoder, so a corrupt one leaves it where the last good one did
+        for (auto name : introduced) {
+            dictionary_.add(std::string{name});
+        }
+        last_id_ = id;
+        pos = in.pos;
+        return EncodedEvent{id, EntityDescriptor{entity_id, type}, count, fields, in.pos, &dictionary_};
+    }
+
+    //a self contained batch, for snapshots and transport: a count, then the events through one fresh encoder
+    inline std::string encode_events(const std::vector<Event> &events) {
+        std::string out{};
+        codec::put_varint(out, events.size());
+
+        EventEncoder encoder{};
+        for (auto &evt : events) {
+            encoder.encode(evt, out);
+        }
+        return out;
+    }
+
+    inline std::vector<Event> decode_events(const std::string &batch) {
+        codec::Reader in{batch.data(), batch.data() + batch.size()};
+        auto count = in.varint();
+
+        std::vector<Event> events{};
+        events.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(count, batch.size())));
+
+        EventDecoder decoder{};
+        auto pos = in.pos;
+        for (std::uint64_t i = 0; i < count; ++i) {
+            events.push_back(decoder.decode(pos, in.end));
+        }
+        return events;
+    }
+
+}
+
+#endif //EVENTVIEW_CODEC_H
@@ -0,0 +1,110 @@
+
+#ifndef EVENTVIEW_DEPENDENCIES_H
+#define EVENTVIEW_DEPENDENCIES_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "types.h"
+
+namespace eventview {
+
+    using ReverseField = std::pair<EntityDescriptor, std::string>;
+
+    /*
+     * Everything a read looked at: nodes whose fields were read (or whose absence was observed) and the
+     * reverse-ref fields that were fanned out over. A publish that touches none of these cannot change the view.
+     */
+    struct ReadDependencies {
+        std::vector<EntityDescriptor> nodes;
+        std::vector<ReverseField> reverse_fields;
+    };
+
+}
+
+namespace std {
+
+    template<>
+    struct hash<eventview::ReverseField> {
+        std::size_t operator()(const eventview::ReverseField &rf) const {
+            return hash<eventview::EntityDescriptor>()(rf.first) ^ (hash<string>()(rf.second) << 1ull);
+        }
+    };
+
+}
+
+namespace eventview {
+
+    /*
+     * Reverse index from dependencies to the ids of whatever recorded them, so a publish can find the affected
+     * entries directly instead of re-checking every one.
+     */
+    class DependencyIndex final {
+    public:
+        using ID = std::uint64_t;
+
+        DependencyIndex() = default;
+
+        DependencyIndex(const DependencyIndex &) = delete;
+
+        DependencyIndex &operator=(const DependencyIndex &) = delete;
+
+        DependencyIndex(DependencyIndex &&) = default;
+
+        DependencyIndex &operator=(DependencyIndex &&) = default;
+
+        ~DependencyIndex() = default;
+
+        inline void add(ID id, const ReadDependencies &deps);
+
+        inline void remove(ID id, const ReadDependencies &deps);
+
+        const std::unordered_set<ID> *find_node(const EntityDescriptor &node) const {
+            auto found = by_node_.find(node);
+            return found == by_node_.end() ? nullptr : &found->second;
+        }
+
+        const std::unordered_set<ID> *find_reverse_field(const EntityDescriptor &node, const std::string &field) const {
+            auto found = by_reverse_field_.find(ReverseField{node, field});
+            return found == by_reverse_field_.end() ? nullptr : &found->second;
+        }
+
+    private:
+        template<typename Index, typename Dep>
+        static void remove_from(Index &index, const Dep &dep, ID id) {
+            auto found = index.find(dep);
+            if (found != index.end()) {
+                found->second.erase(id);
+                if (found->second.empty()) {
+                    index.erase(found);
+                }
+            }
+        }
+
+        std::unordered_map<EntityDescriptor, std::unordered_set<ID>> by_node_;
+        std::unordered_map<ReverseField, std::unordered_set<ID>> by_reverse_field_;
+    };
+
+    inline void DependencyIndex::add(ID id, const ReadDependencies &deps) {
+        for (auto &node : deps.nodes) {
+            by_node_[node].insert(id);
+        }
+        for (auto &field : deps.reverse_fields) {
+            by_reverse_field_[field].insert(id);
+        }
+    }
+
+    inline void DependencyIndex::remove(ID id, const ReadDependencies &deps) {
+        for (auto &node : deps.nodes) {
+            remove_from(by_node_, node, id);
+        }
+        for (auto &field : deps.reverse_fields) {
+            remove_from(by_reverse_field_, field, id);
+        }
+    }
+
+}
+
+#endif //EVENTVIEW_DEPENDENCIES_H
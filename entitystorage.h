@@ -3,7 +3,11 @@
 #define EVENTVIEW_ENTITYSTORAGE_H
 
 #include "types.h"
+#include <algorithm>
 #include <unordered_map>
+#include <map>
+#include <set>
+#include <limits>
 #include <string>
 #include <vector>
 #include <exception>
@@ -33,7 +37,28 @@ namespace eventview {
         }
     };
 
-    using ReferenceSet = std::unordered_map<EntityDescriptor, Existence>;
+    struct DescriptorOrder {
+        bool operator()(const EntityDescriptor &lhs, const EntityDescriptor &rhs) const {
+            return lhs.id < rhs.id || (lhs.id == rhs.id && lhs.type < rhs.type);
+        }
+    };
+
+    //ordered by referencer id so fan-outs can be paged with a stable resume cursor
+    using ReferenceSet = std::map<EntityDescriptor, Existence, DescriptorOrder>;
+
+    struct EdgeTime {
+        EventID time;
+        EntityDescriptor referencer;
+    };
+
+    struct EdgeTimeOrder {
+        bool operator()(const EdgeTime &lhs, const EdgeTime &rhs) const {
+            return lhs.time < rhs.time || (lhs.time == rhs.time && DescriptorOrder{}(lhs.referencer, rhs.referencer));
+        }
+    };
+
+    //live edges of one field ordered by the time they were last written
+    using EdgeTimeIndex = std::set<EdgeTime, EdgeTimeOrder>;
     using RemovedReferences = std::unordered_map<std::string, EntityDescriptor>;
 
     class StorageNode final {
@@ -65,6 +90,55 @@ namespace eventview {
 
         inline std::vector<EntityDescriptor> referencers_for_field(const std::string &field) const;
 
+        //live referencers of the given type through field, kept up to date on every edge change
+        inline std::size_t referencer_count(const std::string &field, EntityTypeID type) const;
+
+        /*
+         * Visits live referencers through field with an id greater than after, in id order, without taking a
+         * snapshot. The visitor returns false to stop early.
+         */
+        template<typename Visitor>
+        void visit_referencers(const std::string &field, EntityID after, Visitor &&visitor) const {
+            auto refs_by_field = referencers_.find(field);
+            if (refs_by_field == referencers_.end()) {
+                return;
+            }
+
+            auto &field_refs = refs_by_field->second;
+            for (auto i = field_refs.upper_bound(EntityDescriptor{after, std::numeric_limits<EntityTypeID>::max()}); i != field_refs.end(); ++i) {
+                if (i->second.exists() && !visitor(i->first)) {
+                    return;
+                }
+            }
+        }
+
+        /*
+         * Visits live referencers through field by the time their edge was last written, newest first when asked,
+         * so the first K cost O(K) rather than a scan and sort of the whole field. The visitor returns false to stop.
+         */
+        template<typename Visitor>
+        void visit_referencers_by_time(const std::string &field, bool newest_first, Visitor &&visitor) const {
+            auto by_field = edge_times_.find(field);
+            if (by_field == edge_times_.end()) {
+                return;
+            }
+
+            auto &edges = by_field->second;
+            if (newest_first) {
+                for (auto i = edges.rbegin(); i != edges.rend(); ++i) {
+                    if (!visitor(i->referencer)) {
+                        return;
+                    }
+                }
+            } else {
+                for (auto &edge : edges) {
+                    if (!visitor(edge.referencer)) {
+                        return;
+                    }
+                }
+            }
+        }
+
         inline RemovedReferences update_fields(EventID update_time, const Entity &update);
 
         const Entity::Fields& get_fields() const {
@@ -91,6 +165,8 @@ namespace eventview {
         Existence existence_;
         Entity entity_;
         std::unordered_map<std::string, ReferenceSet> referencers_;
+        std::unordered_map<std::string, std::unordered_map<EntityTypeID, std::size_t>> degrees_;
+        std::unordered_map<std::string, EdgeTimeIndex> edge_times_;
     };
 
     inline void
@@ -98,8 +174,21 @@ namespace eventview {
         auto &refs_by_field = referencers_[field_name];
 
         auto &found = refs_by_field[referencer];
+        auto was_live = found.exists();
+        auto &edges = edge_times_[field_name];
+        if (was_live) {
+            edges.erase(EdgeTime{found.add_time, referencer});
+        }
+
         found.touch(write_time);
         existence_.touch(write_time);
+
+        if (found.exists()) {
+            edges.insert(EdgeTime{found.add_time, referencer});
+        }
+        if (!was_live && found.exists()) {
+            ++degrees_[field_name][referencer.type];
+        }
     }
 
     inline void
@@ -108,8 +197,14 @@ namespace eventview {
         auto &refs_by_field = referencers_[field_name];
 
         auto &found = refs_by_field[referencer];
+        auto was_live = found.exists();
         found.deref(write_time);
         existence_.touch(write_time);
+
+        if (was_live && !found.exists()) {
+            --degrees_[field_name][referencer.type];
+            edge_times_[field_name].erase(EdgeTime{found.add_time, referencer});
+        }
     }
 
     inline std::vector<EntityDescriptor> StorageNode::referencers_for_field(const std::string &field) const {
@@ -117,9 +212,9 @@ namespace eventview {
 
         auto refs_by_field = referencers_.find(field);
         if (refs_by_field != referencers_.end()) {
-            auto field_refs = refs_by_field->second;
+            auto &field_refs = refs_by_field->second;
 
-            for (auto kv : field_refs) {
+            for (auto &kv : field_refs) {
                 if (kv.second.exists()) {
                     snapshot.push_back(kv.first);
                 }
@@ -129,6 +224,16 @@ namespace eventview {
         return std::move(snapshot);
     }
 
+    inline std::size_t StorageNode::referencer_count(const std::string &field, EntityTypeID type) const {
+        auto by_field = degrees_.find(field);
+        if (by_field == degrees_.end()) {
+            return 0;
+        }
+
+        auto by_type = by_field->second.find(type);
+        return by_type == by_field->second.end() ? 0 : by_type->second;
+    }
+
     inline RemovedReferences StorageNode::update_fields(EventID update_time, const Entity &update) {
         std::unordered_map<std::string, EntityDescriptor> snapshot;
 
@@ -168,8 +273,22 @@ namespace eventview {
 
         std::optional<std::reference_wrapper<StorageNode> > get(const EntityDescriptor &descriptor);
 
+        //ids of every stored entity of the type, stubs included, in the order they were first stored
+        inline const std::vector<EntityID> &entities_of_type(EntityTypeID type) const;
+
+        std::size_t size() const {
+            return store_.size();
+        }
+
+        /*
+         * Moves every node of a store holding none of this store's ids into this one. The ids of each type end up
+         * in id order, which for snowflake ids is close to the order they were first stored.
+         */
+        inline void merge(EntityStore &&other);
+
     private:
         std::unordered_map<EntityID, StorageNode> store_;
+        std::unordered_map<EntityTypeID, std::vector<EntityID>> by_type_;
     };
 
     inline const RemovedReferences EntityStore::put(EventID write_time, Entity entity) {
@@ -177,6 +296,7 @@ namespace eventview {
         auto found = store_.find(desc_id);
 
         if (found == store_.end()) {
+            by_type_[entity.descriptor().type].push_back(desc_id);
             store_.insert(std::make_pair(desc_id, StorageNode{write_time, std::move(entity)}));
             return {};
         } else {
@@ -198,6 +318,29 @@ namespace eventview {
         return {};
     }
 
+    inline void EntityStore::merge(EntityStore &&other) {
+        store_.reserve(store_.size() + other.store_.size());
+        for (auto &kv : other.store_) {
+            store_.insert(std::make_pair(kv.first, std::move(kv.second)));
+        }
+
+        for (auto &kv : other.by_type_) {
+            auto &ids = by_type_[kv.first];
+            ids.insert(ids.end(), kv.second.begin(), kv.second.end());
+            std::sort(ids.begin(), ids.end());
+        }
+
+        other.store_.clear();
+        other.by_type_.clear();
+    }
+
+    inline const std::vector<EntityID> &EntityStore::entities_of_type(EntityTypeID type) const {
+        static const std::vector<EntityID> none{};
+
+        auto found = by_type_.find(type);
+        return found == by_type_.end() ? none : found->second;
+    }
+
 }
 
 #endif //EVENTVIEW_ENTITYSTORAGE_H
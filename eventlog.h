@@ -42,6 +42,13 @@ namespace eventview {
             }
         }
 
+        //replays the events with ids from the given one on, for storage that can seek such as SegmentedLogStorage
+        void replay_from(EventID from) {
+            storage_.replay_from(from, [&](Event &&evt) {
+                publisher_(std::move(evt));
+            });
+        }
+
     private:
         Storage storage_;
         EventReceiver publisher_;
@@ -14,17 +14,40 @@
 #include "publish.h"
 #include "publishimpl.h"
 #include "eventwriter.h"
+#include "filelog.h"
+#include "segmentedlog.h"
 
 namespace eventview {
 
+    struct SystemOptions {
+        //0 disables the view cache
+        std::size_t view_cache_entries = 0;
+        //secondary indexes to maintain, reachable through ViewDescriptor::lookup
+        std::vector<IndexedField> indexed_fields{};
+        //lets identical reads queued at the same time share one evaluation, see OpDispatch::read_view
+        bool coalesce_reads = false;
+    };
+
     template<std::uint32_t NumThreads>
-    std::pair<Publisher<NumThreads>, ViewReader<NumThreads>> make_eventview_system() {
+    std::pair<Publisher<NumThreads>, ViewReader<NumThreads>> make_eventview_system(SystemOptions options = {}) {
 
         auto store = std::make_shared<EntityStore>();
 
-        auto reader_impl_ptr = std::make_shared<ViewReaderImpl>(store);
+        std::shared_ptr<ViewCache> cache{};
+        if (options.view_cache_entries > 0) {
+            cache = std::make_shared<ViewCache>(options.view_cache_entries);
+        }
+
+        std::shared_ptr<FieldIndexes> indexes{};
+        if (!options.indexed_fields.empty()) {
+            indexes = std::make_shared<FieldIndexes>(options.indexed_fields);
+        }
+
+        auto reader_impl_ptr = std::make_shared<ViewReaderImpl>(store, cache, indexes);
+
+        auto subscriptions = std::make_shared<SubscriptionRegistry>(reader_impl_ptr);
 
-        auto pub_impl_ptr = std::make_shared<PublisherImpl>(store);
+        auto pub_impl_ptr = std::make_shared<PublisherImpl>(store, cache, subscriptions, indexes);
 
         EventPublishCallback pub_cb = [=](Event &&evt) {
             pub_impl_ptr->publish(std::move(evt));
@@ -34,10 +57,15 @@ namespace eventview {
             return reader_impl_ptr->read_view(view_desc);
         };
 
-        auto dispatch_ptr = std::make_shared<OpDispatch<NumThreads>>(pub_cb, view_cb);
+        ColumnReadCallback columns_cb = [=](const ColumnRequest &req) -> ColumnarView {
+            return reader_impl_ptr->read_columns(*req.plan, req.roots);
+        };
 
-        Publisher<NumThreads> pub{dispatch_ptr};
-        ViewReader reader{dispatch_ptr};
+        auto dispatch_ptr = std::make_shared<OpDispatch<NumThreads>>(pub_cb, view_cb, columns_cb,
+                                                                     options.coalesce_reads);
+
+        Publisher<NumThreads> pub{dispatch_ptr, pub_impl_ptr};
+        ViewReader reader{dispatch_ptr, cache, subscriptions, reader_impl_ptr};
 
         return {std::move(pub), std::move(reader)};
     };
@@ -55,6 +83,17 @@ namespace eventview {
         }};
     }
 
+    template<std::uint32_t NumThreads, typename LogStorage>
+    EventWriter<LogStorage> make_writer(std::uint32_t writer_id, Publisher<NumThreads> &publisher, LogStorage storage) {
+
+        return EventWriter<LogStorage>{writer_id, [&](Event &&evt) {
+            auto result = publisher.publish(std::move(evt));
+            if (!result) {
+                throw std::runtime_error{result.error()};
+            }
+        }, std::move(storage)};
+    }
+
     EventReceiver NoOpReceiver = [](const Event &evt){};
 
     template<typename LogStorage = std::vector<Event>>
@@ -63,6 +102,12 @@ namespace eventview {
         return EventWriter<LogStorage>{writer_id, receiver};
     }
 
+    template<typename LogStorage>
+    EventWriter<LogStorage> make_writer(std::uint32_t writer_id, const EventReceiver &receiver, LogStorage storage) {
+
+        return EventWriter<LogStorage>{writer_id, receiver, std::move(storage)};
+    }
+
     class WriteReadResult final {
     public:
         WriteReadResult(WriteResult result, std::optional<View> view) : result_{std::move(result)},
@@ -91,9 +136,14 @@ namespace eventview {
         std::optional<View> view_;
     };
 
+    /*
+     * A non-zero wait lets the read park on the worker until the write is visible instead of returning empty when
+     * the expectation is not met yet.
+     */
     template<std::uint32_t NumThreads, typename LogStorage = std::vector<Event>>
     WriteReadResult write_and_read(EventWriter<LogStorage>& writer, Entity evt,
-            const ViewReader<NumThreads> &reader, ViewDescriptor view_desc) noexcept {
+            const ViewReader<NumThreads> &reader, ViewDescriptor view_desc,
+            std::chrono::milliseconds wait = std::chrono::milliseconds{0}) noexcept {
         auto result = writer.write_event(evt);
 
         if (result) {
@@ -109,7 +159,7 @@ namespace eventview {
                 view_desc.expectation = {desc, result.event_id()};
             }
 
-            auto view = reader.read_view(view_desc);
+            auto view = wait.count() > 0 ? reader.read_view(view_desc, wait) : reader.read_view(view_desc);
 
             return WriteReadResult(result, view);
         }
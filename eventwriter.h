@@ -51,6 +51,11 @@ namespace eventview {
                 snowflakes_{SnowflakeProvider{writer_id}},
                 log_{EventLog<LogStorage>{std::move(receiver)}} {}
 
+        //appends to the given storage, e.g. a FileLogStorage sharing its LogFile with other writers
+        EventWriter(std::uint32_t writer_id, EventReceiver receiver, LogStorage storage) :
+                snowflakes_{SnowflakeProvider{writer_id}},
+                log_{EventLog<LogStorage>{std::move(receiver), std::move(storage)}} {}
+
         inline const WriteResult write_event(Entity evt) noexcept;
 
         EventID next_id() {
@@ -0,0 +1,324 @@
+
+#ifndef EVENTVIEW_FIELDINDEX_H
+#define EVENTVIEW_FIELDINDEX_H
+
+#include <cmath>
+#include <set>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+
+#include "types.h"
+#include "entitystorage.h"
+
+namespace eventview {
+
+    struct PrimitiveFieldValueHash {
+        std::size_t operator()(const PrimitiveFieldValue &value) const {
+            return std::hash<decltype(value.val)>()(value.val);
+        }
+    };
+
+    /*
+     * Total order over field values for ordered indexes. Numbers compare by exact value whether stored as uint64_t
+     * or double, with NaN after every other number, and sort before strings, which sort before bools and
+     * descriptors.
+     */
+    struct PrimitiveFieldValueOrder {
+        static int rank(const PrimitiveFieldValue &value) {
+            if (value.is_long() || value.is_double()) {
+                return 0;
+            }
+            if (value.is_string()) {
+                return 1;
+            }
+            return value.is_descriptor() ? 3 : 2;
+        }
+
+        bool operator()(const PrimitiveFieldValue &lhs, const PrimitiveFieldValue &rhs) const {
+            auto lhs_rank = rank(lhs);
+            auto rhs_rank = rank(rhs);
+            if (lhs_rank != rhs_rank) {
+                return lhs_rank < rhs_rank;
+            }
+
+            switch (lhs_rank) {
+                case 0:
+                    return number_less(lhs, rhs);
+                case 1:
+                    return lhs.as_string() < rhs.as_string();
+                case 3:
+                    return DescriptorOrder{}(lhs.as_descriptor(), rhs.as_descriptor());
+                default:
+                    return std::get<bool>(lhs.val) < std::get<bool>(rhs.val);
+            }
+        }
+
+    private:
+        //2^64, the first double past every uint64_t
+        static constexpr std::double_t LONG_LIMIT = 18446744073709551616.0;
+
+        static bool number_less(const PrimitiveFieldValue &lhs, const PrimitiveFieldValue &rhs) {
+            if (lhs.is_long() && rhs.is_long()) {
+                return lhs.as_long() < rhs.as_long();
+            }
+
+            //NaN compares false against everything, so it is ordered explicitly to keep the order strict weak
+            auto lhs_nan = lhs.is_double() && std::isnan(lhs.as_double());
+            auto rhs_nan = rhs.is_double() && std::isnan(rhs.as_double());
+            if (lhs_nan || rhs_nan) {
+                return !lhs_nan;
+            }
+
+            if (lhs.is_double() && rhs.is_double()) {
+                return lhs.as_double() < rhs.as_double();
+            }
+            if (lhs.is_long()) {
+                return long_less_double(lhs.as_long(), rhs.as_double());
+            }
+            return double_less_long(lhs.as_double(), rhs.as_long());
+        }
+
+        //casting the uint64_t to double would round it, so the double's whole part is compared as an integer
+        static bool long_less_double(std::uint64_t lhs, std::double_t rhs) {
+            if (rhs < 0) {
+                return false;
+            }
+            if (rhs >= LONG_LIMIT) {
+                return true;
+            }
+            auto whole = static_cast<std::uint64_t>(rhs);
+            return lhs < whole || (lhs == whole && rhs > static_cast<std::double_t>(whole));
+        }
+
+        static bool double_less_long(std::double_t lhs, std::uint64_t rhs) {
+            if (lhs < 0) {
+                return true;
+            }
+            if (lhs >= LONG_LIMIT) {
+                return false;
+            }
+            return static_cast<std::uint64_t>(lhs) < rhs;
+        }
+    };
+
+    /*
+     * Secondary indexes from field values to the ids of the entities holding them, declared per (type, field) up
+     * front. Indexes are maintained from what the store holds after each put rather than from the event itself, so
+     * a late write that loses to a newer one under LWW never reaches an index. Only the dispatch worker touches them.
+     */
+    class FieldIndexes final {
+    public:
+        explicit FieldIndexes(const std::vector<IndexedField> &fields) {
+            for (auto &field : fields) {
+                by_type_[field.type][field.field].kind = field.kind;
+            }
+        }
+
+        FieldIndexes(const FieldIndexes &) = delete;
+
+        FieldIndexes &operator=(const FieldIndexes &) = delete;
+
+        ~FieldIndexes() = default;
+
+        bool indexed(EntityTypeID type) const {
+            return by_type_.find(type) != by_type_.end();
+        }
+
+        //values of the indexed fields of node, captured before a put so update can tell what changed
+        inline Entity::Fields snapshot(const StorageNode &node) const;
+
+        inline void update(const EntityDescriptor &desc, const Entity::Fields &before, const StorageNode &after);
+
+        //the lowest id whose field currently equals the lookup's value, if any
+        inline std::optional<EntityDescriptor> resolve(const IndexLookup &lookup) const;
+
+        /*
+         * Visits the ids in a range scan's page in (value, id) order. Returns the cursor to resume after when the
+         * page stopped at its limit with matches left over. A field without an ordered index has no matches.
+         */
+        template<typename Visitor>
+        std::optional<ScanCursor> scan(const RangeScan &range, Visitor &&visitor) const {
+            auto index = find(range.type, range.field);
+            if (!index || index->kind != IndexKind::Ordered) {
+                return {};
+            }
+
+            PrimitiveFieldValueOrder less{};
+            auto &ordered = index->ordered;
+            auto i = ordered.begin();
+            if (range.after) {
+                i = ordered.upper_bound(Entry{range.after->value, range.after->id});
+            } else if (range.prefix) {
+                //strings sharing a prefix are contiguous in the order, starting at the prefix itself
+                PrimitiveFieldValue start{*range.prefix};
+                if (range.lower && less(start, *range.lower)) {
+                    start = *range.lower;
+                }
+                i = ordered.lower_bound(Entry{start, 0});
+            } else if (range.lower) {
+                i = ordered.lower_bound(Entry{*range.lower, 0});
+            }
+
+            std::size_t taken = 0;
+            for (; i != ordered.end(); ++i) {
+                if (range.upper && less(*range.upper, i->value)) {
+                    break;
+                }
+                if (range.prefix && !has_prefix(i->value, *range.prefix)) {
+                    break;
+                }
+                if (range.lower && less(i->value, *range.lower)) {
+                    continue;
+                }
+                if (range.limit > 0 && taken == range.limit) {
+                    auto last = std::prev(i);
+                    return ScanCursor{last->value, last->id};
+                }
+
+                ++taken;
+                visitor(i->id);
+            }
+
+            return {};
+        }
+
+    private:
+        struct Entry {
+            PrimitiveFieldValue value;
+            EntityID id;
+        };
+
+        struct EntryOrder {
+            bool operator()(const Entry &lhs, const Entry &rhs) const {
+                PrimitiveFieldValueOrder less{};
+                if (less(lhs.value, rhs.value)) {
+                    return true;
+                }
+                if (less(rhs.value, lhs.value)) {
+                    return false;
+                }
+                return lhs.id < rhs.id;
+            }
+        };
+
+        struct Index {
+            IndexKind kind = IndexKind::Equality;
+            std::unordered_map<PrimitiveFieldValue, std::set<EntityID>, PrimitiveFieldValueHash> equal{};
+            std::set<Entry, EntryOrder> ordered{};
+        };
+
+        static bool has_prefix(const PrimitiveFieldValue &value, const std::string &prefix) {
+            return value.is_string() && value.as_string().compare(0, prefix.size(), prefix) == 0;
+        }
+
+        const Index *find(EntityTypeID type, const std::string &field) const {
+            auto by_field = by_type_.find(type);
+            if (by_field == by_type_.end()) {
+                return nullptr;
+            }
+
+            auto index = by_field->second.find(field);
+            return index == by_field->second.end() ? nullptr : &index->second;
+        }
+
+        inline static void remove(Index &index, const PrimitiveFieldValue &value, EntityID id);
+
+        inline static void add(Index &index, const PrimitiveFieldValue &value, EntityID id);
+
+        std::unordered_map<EntityTypeID, std::unordered_map<std::string, Index>> by_type_;
+    };
+
+    inline Entity::Fields FieldIndexes::snapshot(const StorageNode &node) const {
+        Entity::Fields values{};
+
+        auto by_field = by_type_.find(node.type());
+        if (by_field != by_type_.end()) {
+            auto &fields = node.get_fields();
+            for (auto &kv : by_field->second) {
+                auto found = fields.find(kv.first);
+                if (found != fields.end()) {
+                    values.emplace(kv.first, found->second);
+                }
+            }
+        }
+
+        return values;
+    }
+
+    inline void FieldIndexes::update(const EntityDescriptor &desc, const Entity::Fields &before,
+                                     const StorageNode &after) {
+        auto by_field = by_type_.find(desc.type);
+        if (by_field == by_type_.end()) {
+            return;
+        }
+
+        auto &fields = after.get_fields();
+        for (auto &kv : by_field->second) {
+            auto old_val = before.find(kv.first);
+            auto new_val = fields.find(kv.first);
+
+            auto had = old_val != before.end();
+            auto has = new_val != fields.end();
+            if (had && has && old_val->second == new_val->second) {
+                continue;
+            }
+
+            if (had) {
+                remove(kv.second, old_val->second, desc.id);
+            }
+            if (has) {
+                add(kv.second, new_val->second, desc.id);
+            }
+        }
+    }
+
+    inline void FieldIndexes::remove(Index &index, const PrimitiveFieldValue &value, EntityID id) {
+        if (index.kind == IndexKind::Ordered) {
+            index.ordered.erase(Entry{value, id});
+            return;
+        }
+
+        auto ids = index.equal.find(value);
+        if (ids != index.equal.end()) {
+            ids->second.erase(id);
+            if (ids->second.empty()) {
+                index.equal.erase(ids);
+            }
+        }
+    }
+
+    inline void FieldIndexes::add(Index &index, const PrimitiveFieldValue &value, EntityID id) {
+        if (index.kind == IndexKind::Ordered) {
+            index.ordered.insert(Entry{value, id});
+        } else {
+            index.equal[value].insert(id);
+        }
+    }
+
+    inline std::optional<EntityDescriptor> FieldIndexes::resolve(const IndexLookup &lookup) const {
+        auto index = find(lookup.type, lookup.field);
+        if (!index) {
+            return {};
+        }
+
+        if (index->kind == IndexKind::Ordered) {
+            auto first = index->ordered.lower_bound(Entry{lookup.value, 0});
+            if (first == index->ordered.end() || PrimitiveFieldValueOrder{}(lookup.value, first->value)) {
+                return {};
+            }
+            return EntityDescriptor{first->id, lookup.type};
+        }
+
+        auto ids = index->equal.find(lookup.value);
+        if (ids == index->equal.end() || ids->second.empty()) {
+            return {};
+        }
+        return EntityDescriptor{*ids->second.begin(), lookup.type};
+    }
+
+}
+
+#endif //EVENTVIEW_FIELDINDEX_H
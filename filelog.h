@@ -0,0 +1,649 @@
+
+#ifndef EVENTVIEW_FILELOG_H
+#define EVENTVIEW_FILELOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "codec.h"
+
+namespace eventview {
+
+    enum class Durability {
+        //every append is written and synced before it returns
+        EveryWrite,
+        //appends wait for a shared sync that covers every writer that appended since the last one
+        GroupCommit,
+        //every append is written before it returns but not synced; the OS decides when data reaches the disk
+        OsBuffered
+    };
+
+    struct LogFileOptions {
+        Durability durability = Durability::GroupCommit;
+        //how long a group commit gathers appends before syncing them
+        std::chrono::microseconds commit_interval{200};
+        //a group commit starts early once this many bytes are pending
+        std::size_t commit_bytes = 1u << 20u;
+        //the encoder restarts after this many bytes, giving replay a place to start reading mid-file
+        std::size_t restart_bytes = 64u << 10u;
+    };
+
+    //where to read events from: a file, a restart point in it, and optionally where to stop
+    struct LogPosition {
+        std::string path;
+        std::uint64_t offset;
+        std::uint64_t end = std::numeric_limits<std::uint64_t>::max();
+    };
+
+    //a record where the encoder restarted, and the highest event id anywhere before it
+    struct RestartPoint {
+        EventID max_before;
+        std::uint64_t offset;
+    };
+
+    struct LogFileIndex {
+        std::vector<RestartPoint> restarts{};
+        EventID min_id = std::numeric_limits<EventID>::max();
+        EventID max_id = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t records = 0;
+
+        /*
+         * Where to start reading for the events with ids from the given one on. Ids are only roughly ordered in the
+         * file, so this is the last restart with nothing that high before it; readers still filter by id.
+         */
+        std::uint64_t seek(EventID from) const {
+            auto after = std::partition_point(restarts.begin(), restarts.end(), [&](const RestartPoint &point) {
+                return point.max_before < from;
+            });
+            return after == restarts.begin() ? 0 : std::prev(after)->offset;
+        }
+
+        //the file split at every restart point, into pieces that can be decoded independently
+        std::vector<LogPosition> chunks(const std::string &path) const {
+            std::vector<LogPosition> pieces{};
+            for (std::size_t i = 0; i < restarts.size(); ++i) {
+                auto end = i + 1 < restarts.size() ? restarts[i + 1].offset : bytes;
+                pieces.push_back(LogPosition{path, restarts[i].offset, end});
+            }
+            return pieces;
+        }
+    };
+
+    /*
+     * An append-only file of length and checksum framed records, one encoded event each, shared by every writer
+     * appending to it. Group commit batches the pending appends of all writers into one write and one sync on a
+     * flusher thread, so the cost of a sync is spread over everything that arrived while the previous one ran.
+     * Events are encoded in file order through one EventEncoder, which restarts every restart_bytes so that a
+     * reader can start at any restart point instead of the start of the file. A failed write or sync cuts the
+     * file back to the last record known to be whole and fails every append after it, so nothing acknowledged
+     * is ever stranded behind a torn record.
+     */
+    class LogFile final {
+    public:
+        //set in a record's length when the encoder restarted at it
+        static constexpr std::uint32_t RESTART_FLAG = 0x80000000u;
+
+        inline explicit LogFile(std::string path, LogFileOptions options = {});
+
+        LogFile(const LogFile &) = delete;
+
+        LogFile &operator=(const LogFile &) = delete;
+
+        inline ~LogFile();
+
+        //returns once the event is as durable as the file's mode promises; throws once the file has failed
+        inline void append(const Event &evt);
+
+        //writes and syncs everything appended so far
+        inline void flush();
+
+        //true once a write or sync failed; the file then holds only what was appended before the failure
+        bool failed() const {
+            std::lock_guard<std::mutex> lock{mutex_};
+            return failed_;
+        }
+
+        const std::string &path() const {
+            return path_;
+        }
+
+        LogFileIndex index() const {
+            std::lock_guard<std::mutex> lock{mutex_};
+            return index_;
+        }
+
+        //bytes appended so far, whether or not they have reached the file yet
+        std::uint64_t bytes() const {
+            std::lock_guard<std::mutex> lock{mutex_};
+            return index_.bytes;
+        }
+
+        //the lowest event id appended so far, if any
+        std::optional<EventID> min_id() const {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (index_.records == 0) {
+                return {};
+            }
+            return index_.min_id;
+        }
+
+        /*
+         * Reads the next record. Fails at the first torn or corrupt record, which is what a crash in the middle of
+         * an append leaves behind.
+         */
+        inline static bool read_record(std::istream &in, std::string &record, bool &restart);
+
+        //indexes the complete records of a file, leaving decoder where the last one left it
+        inline static LogFileIndex scan(const std::string &path, EventDecoder &decoder);
+
+    private:
+        inline static std::uint32_t checksum(const char *data, std::size_t len);
+
+        //appends the event's frame to out; mutex_ must be held
+        inline void frame(const Event &evt, std::string &out);
+
+        inline void recover();
+
+        inline void write_out(const std::string &bytes);
+
+        inline void sync();
+
+        //writes bytes framed after everything already written, syncing them if asked; io_mutex_ must be held
+        inline void commit(const std::string &bytes, bool synced);
+
+        //cuts the file back to written_, reindexes what is left and fails the file; io_mutex_ must be held
+        inline void fail();
+
+        inline void flush_loop();
+
+        std::string path_;
+        LogFileOptions options_;
+        int fd_;
+
+        //lock order is io_mutex_ then mutex_, so buffers reach the file in the order they were taken
+        std::mutex io_mutex_;
+        mutable std::mutex mutex_;
+        std::condition_variable pending_;
+        std::condition_variable durable_;
+        EventEncoder encoder_;
+        LogFileIndex index_;
+        std::uint64_t restarted_at_;
+        std::string buffer_;
+        //bytes known to be whole in the file; only changed under io_mutex_
+        std::uint64_t written_;
+        std::uint64_t appended_;
+        std::uint64_t synced_;
+        bool failed_;
+        bool stopping_;
+        std::thread flusher_;
+    };
+
+    inline LogFile::LogFile(std::string path, LogFileOptions options) : path_{std::move(path)}, options_{options},
+                                                                        fd_{-1}, restarted_at_{0}, written_{0}, appended_{0},
+                                                                        synced_{0}, failed_{false}, stopping_{false} {
+        recover();
+        written_ = index_.bytes;
+
+        fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd_ < 0) {
+            throw std::runtime_error{"unable to open event log " + path_};
+        }
+
+        if (options_.durability == Durability::GroupCommit) {
+            flusher_ = std::thread{[this] { flush_loop(); }};
+        }
+    }
+
+    inline LogFile::~LogFile() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stopping_ = true;
+        }
+        pending_.notify_all();
+
+        if (flusher_.joinable()) {
+            flusher_.join();
+        }
+
+        try {
+            flush();
+        } catch (...) {
+            //nothing left to report a failed final flush to
+        }
+        ::close(fd_);
+    }
+
+    inline void LogFile::append(const Event &evt) {
+        if (options_.durability != Durability::GroupCommit) {
+            //framed and written under io_mutex_, so records reach the file in the order they were encoded
+            std::lock_guard<std::mutex> io_lock{io_mutex_};
+            std::string bytes{};
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                if (failed_) {
+                    throw std::runtime_error{"event log " + path_ + " failed an earlier write"};
+                }
+                frame(evt, bytes);
+            }
+            commit(bytes, options_.durability == Durability::EveryWrite);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock{mutex_};
+        if (failed_) {
+            throw std::runtime_error{"event log " + path_ + " failed an earlier write"};
+        }
+        frame(evt, buffer_);
+        auto seq = ++appended_;
+
+        if (buffer_.size() >= options_.commit_bytes) {
+            pending_.notify_one();
+        }
+
+        durable_.wait(lock, [&] { return synced_ >= seq || failed_; });
+        if (synced_ < seq) {
+            throw std::runtime_error{"event log group commit failed for " + path_};
+        }
+    }
+
+    inline void LogFile::frame(const Event &evt, std::string &out) {
+        auto restart = index_.records == 0 ||
+                       (options_.restart_bytes > 0 && index_.bytes - restarted_at_ >= options_.restart_bytes);
+        if (restart) {
+            encoder_.reset();
+            index_.restarts.push_back(RestartPoint{index_.max_id, index_.bytes});
+            restarted_at_ = index_.bytes;
+        }
+
+        auto header = out.size();
+        out.append(8, '\0');
+        encoder_.encode(evt, out);
+
+        auto length = static_cast<std::uint32_t>(out.size() - header - 8);
+        auto sum = checksum(out.data() + header + 8, length);
+        auto flagged = restart ? length | RESTART_FLAG : length;
+        std::memcpy(&out[header], &flagged, 4);
+        std::memcpy(&out[header + 4], &sum, 4);
+
+        index_.bytes += out.size() - header;
+        index_.records += 1;
+        index_.min_id = std::min(index_.min_id, evt.id);
+        index_.max_id = std::max(index_.max_id, evt.id);
+    }
+
+    /*
+     * Picks up the encoder's stream where the existing file ends, and cuts off a torn tail so that new appends
+     * don't land behind a record replay would stop at.
+     */
+    inline void LogFile::recover() {
+        std::ifstream in{path_, std::ios::binary | std::ios::ate};
+        if (!in) {
+            return;
+        }
+
+        EventDecoder decoder{};
+        index_ = scan(path_, decoder);
+        if (!index_.restarts.empty()) {
+            restarted_at_ = index_.restarts.back().offset;
+        }
+
+        auto size = static_cast<std::uint64_t>(in.tellg());
+        if (size > index_.bytes && ::truncate(path_.c_str(), static_cast<off_t>(index_.bytes)) != 0) {
+            throw std::runtime_error{"unable to truncate torn event log " + path_};
+        }
+
+        encoder_ = EventEncoder{decoder.dictionary(), decoder.last_id()};
+    }
+
+    inline LogFileIndex LogFile::scan(const std::string &path, EventDecoder &decoder) {
+        LogFileIndex index{};
+
+        std::ifstream in{path, std::ios::binary};
+        std::string record{};
+        bool restart = false;
+        while (read_record(in, record, restart)) {
+            if (restart || index.records == 0) {
+                decoder.reset();
+                index.restarts.push_back(RestartPoint{index.max_id, index.bytes});
+            }
+
+            EventID id;
+            try {
+                const char *pos = record.data();
+                id = decoder.next(pos, record.data() + record.size()).id();
+            } catch (std::exception &) {
+                if (restart || index.records == 0) {
+                    index.restarts.pop_back();
+                }
+                break;
+            }
+
+            index.bytes += record.size() + 8;
+            index.records += 1;
+            index.min_id = std::min(index.min_id, id);
+            index.max_id = std::max(index.max_id, id);
+        }
+
+        return index;
+    }
+
+    inline void LogFile::flush() {
+        std::lock_guard<std::mutex> io_lock{io_mutex_};
+
+        std::string bytes{};
+        std::uint64_t target;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (failed_) {
+                return;
+            }
+            bytes.swap(buffer_);
+            target = appended_;
+        }
+
+        commit(bytes, options_.durability != Durability::OsBuffered);
+
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            synced_ = std::max(synced_, target);
+        }
+        durable_.notify_all();
+    }
+
+    inline void LogFile::flush_loop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                pending_.wait_for(lock, options_.commit_interval, [&] {
+                    return stopping_ || buffer_.size() >= options_.commit_bytes;
+                });
+
+                if (buffer_.empty()) {
+                    if (stopping_) {
+                        return;
+                    }
+                    continue;
+                }
+            }
+
+            try {
+                flush();
+            } catch (...) {
+                //flush already failed the file and woke the appenders waiting on it
+                return;
+            }
+        }
+    }
+
+    inline void LogFile::commit(const std::string &bytes, bool synced) {
+        try {
+            if (!bytes.empty()) {
+                write_out(bytes);
+            }
+            if (synced) {
+                sync();
+            }
+        } catch (...) {
+            fail();
+            throw;
+        }
+        written_ += bytes.size();
+    }
+
+    inline void LogFile::fail() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            failed_ = true;
+            buffer_.clear();
+
+            //a partial write leaves a torn record, and a failed sync leaves unknown bytes, after the last whole one
+            if (::ftruncate(fd_, static_cast<off_t>(written_)) == 0) {
+                EventDecoder decoder{};
+                index_ = scan(path_, decoder);
+                restarted_at_ = index_.restarts.empty() ? 0 : index_.restarts.back().offset;
+                encoder_ = EventEncoder{decoder.dictionary(), decoder.last_id()};
+            }
+        }
+        durable_.notify_all();
+    }
+
+    inline void LogFile::write_out(const std::string &bytes) {
+        auto data = bytes.data();
+        auto left = bytes.size();
+
+        while (left > 0) {
+            auto written = ::write(fd_, data, left);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error{"unable to write event log " + path_};
+            }
+            data += written;
+            left -= static_cast<std::size_t>(written);
+        }
+    }
+
+    inline void LogFile::sync() {
+#if defined(__linux__)
+        auto result = ::fdatasync(fd_);
+#else
+        auto result = ::fsync(fd_);
+#endif
+        if (result != 0) {
+            throw std::runtime_error{"unable to sync event log " + path_};
+        }
+    }
+
+    inline bool LogFile::read_record(std::istream &in, std::string &record, bool &restart) {
+        char header[8];
+        if (!in.read(header, sizeof(header))) {
+            return false;
+        }
+
+        std::uint32_t length;
+        std::uint32_t sum;
+        std::memcpy(&length, header, 4);
+        std::memcpy(&sum, header + 4, 4);
+
+        restart = (length & RESTART_FLAG) != 0;
+        length &= ~RESTART_FLAG;
+
+        //a torn length can claim up to 2GiB, so the record only grows as far as the file actually holds bytes
+        constexpr std::uint32_t step = 1u << 20u;
+        record.clear();
+        for (std::uint32_t read = 0; read < length;) {
+            auto chunk = std::min(step, length - read);
+            record.resize(read + chunk);
+            if (!in.read(&record[read], chunk)) {
+                return false;
+            }
+            read += chunk;
+        }
+        return checksum(record.data(), record.size()) == sum;
+    }
+
+    inline std::uint32_t LogFile::checksum(const char *data, std::size_t len) {
+        auto hash = fnv_append(FNV_OFFSET, data, len);
+        return static_cast<std::uint32_t>(hash ^ (hash >> 32u));
+    }
+
+
+    //reads a log file's events in order, from the start of the file or one of its restart points up to end
+    class LogReader final {
+    public:
+        explicit LogReader(const LogPosition &position) : in_{position.path, std::ios::binary},
+                                                          at_{position.offset}, end_{position.end} {
+            in_.seekg(static_cast<std::streamoff>(at_));
+        }
+
+        bool next(Event &evt) {
+            bool restart = false;
+            if (at_ >= end_ || !LogFile::read_record(in_, record_, restart)) {
+                return false;
+            }
+            at_ += record_.size() + 8;
+
+            if (restart) {
+                decoder_.reset();
+            }
+            evt = decoder_.decode(record_);
+            return true;
+        }
+
+    private:
+        std::ifstream in_;
+        std::uint64_t at_;
+        std::uint64_t end_;
+        EventDecoder decoder_{};
+        std::string record_{};
+    };
+
+    //reads events back from a sequence of log files, skipping events with ids below from
+    class LogIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Event;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Event *;
+        using reference = const Event &;
+
+        LogIterator() = default;
+
+        explicit LogIterator(std::vector<LogPosition> positions, EventID from = 0) :
+                state_{std::make_shared<State>(State{std::move(positions), 0, nullptr, from})} {
+            advance();
+        }
+
+        reference operator*() const {
+            return current_;
+        }
+
+        pointer operator->() const {
+            return &current_;
+        }
+
+        LogIterator &operator++() {
+            advance();
+            return *this;
+        }
+
+        bool operator==(const LogIterator &other) const {
+            return state_ == other.state_;
+        }
+
+        bool operator!=(const LogIterator &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        struct State {
+            std::vector<LogPosition> positions;
+            std::size_t at;
+            std::unique_ptr<LogReader> reader;
+            EventID from;
+        };
+
+        void advance() {
+            while (state_) {
+                if (state_->reader && state_->reader->next(current_)) {
+                    if (current_.id >= state_->from) {
+                        return;
+                    }
+                    continue;
+                }
+
+                if (state_->at == state_->positions.size()) {
+                    state_.reset();
+                    return;
+                }
+
+                auto &position = state_->positions[state_->at++];
+                state_->reader = std::make_unique<LogReader>(position);
+            }
+        }
+
+        std::shared_ptr<State> state_{};
+        Event current_{};
+    };
+
+    /*
+     * Storage for EventLog and EventWriter that appends every event to a LogFile. Several storages may share one
+     * LogFile, which is how concurrent writers get their appends group committed together.
+     */
+    class FileLogStorage final {
+    public:
+        using const_iterator = LogIterator;
+
+        explicit FileLogStorage(std::shared_ptr<LogFile> file) : file_{std::move(file)} {}
+
+        explicit FileLogStorage(std::string path, LogFileOptions options = {}) :
+                file_{std::make_shared<LogFile>(std::move(path), options)} {}
+
+        FileLogStorage(const FileLogStorage &) = default;
+
+        FileLogStorage &operator=(const FileLogStorage &) = default;
+
+        FileLogStorage(FileLogStorage &&) noexcept = default;
+
+        FileLogStorage &operator=(FileLogStorage &&) noexcept = default;
+
+        ~FileLogStorage() = default;
+
+        void push_back(const Event &evt) {
+            file_->append(evt);
+        }
+
+        const_iterator begin() const {
+            file_->flush();
+            return const_iterator{{LogPosition{file_->path(), 0}}};
+        }
+
+        const_iterator end() const {
+            return const_iterator{};
+        }
+
+        //the whole file in independently decodable pieces, for a parallel bulk replay
+        std::vector<LogPosition> chunks() const {
+            file_->flush();
+            return file_->index().chunks(file_->path());
+        }
+
+        //visits the events with ids from the given one on, starting at the nearest restart point
+        template<typename Visitor>
+        void replay_from(EventID from, Visitor &&visitor) const {
+            file_->flush();
+            auto offset = file_->index().seek(from);
+            for (auto i = const_iterator{{LogPosition{file_->path(), offset}}, from}; i != end(); ++i) {
+                visitor(Event{*i});
+            }
+        }
+
+        const std::shared_ptr<LogFile> &file() const {
+            return file_;
+        }
+
+    private:
+        std::shared_ptr<LogFile> file_;
+    };
+
+}
+
+#endif //EVENTVIEW_FILELOG_H
@@ -10,20 +10,40 @@
 #include <thread>
 #include <chrono>
 #include <optional>
+#include <algorithm>
+#include <mutex>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
 
 #include "types.h"
 #include "mpsc.h"
 
 namespace eventview {
 
+    //work that has to run on the dispatch worker, such as changes to worker-owned registries
+    using Task = std::function<void()>;
+
+    //a read whose expectation may be met by a publish that has not been applied yet
+    struct WaitingRead {
+        ViewDescriptor desc;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
     struct Operation {
-        std::variant<Event, ViewDescriptor> op;
-        std::variant<std::promise<void>, std::promise<std::optional<View> > > res;
+        std::variant<Event, ViewDescriptor, std::vector<ViewDescriptor>, ColumnRequest, Task, WaitingRead> op;
+        std::variant<std::promise<void>, std::promise<std::optional<View> >,
+                std::promise<std::vector<std::optional<View> > >, std::promise<ColumnarView> > res;
 
         Operation(): op{ViewDescriptor{}}, res{std::promise<std::optional<View>>{}}{};
 
         Operation(Event e, std::promise<void> p): op{std::move(e)}, res{std::move(p)} {}
         Operation(ViewDescriptor desc, std::promise<std::optional<View>> v): op{std::move(desc)}, res{std::move(v)} {}
+        Operation(std::vector<ViewDescriptor> descs, std::promise<std::vector<std::optional<View>>> v):
+            op{std::move(descs)}, res{std::move(v)} {}
+        Operation(ColumnRequest req, std::promise<ColumnarView> v): op{std::move(req)}, res{std::move(v)} {}
+        Operation(Task t, std::promise<void> p): op{std::move(t)}, res{std::move(p)} {}
+        Operation(WaitingRead w, std::promise<std::optional<View>> v): op{std::move(w)}, res{std::move(v)} {}
 
         Operation(const Operation &)=delete;
         Operation& operator=(const Operation &)=delete;
@@ -55,18 +75,65 @@ namespace eventview {
         std::promise<std::optional<View>> take_read_res() {
             return std::move(*std::get_if<std::promise<std::optional<View>>>(&res));
         }
+
+        bool is_batch_read() {
+            return std::holds_alternative<std::vector<ViewDescriptor>>(op);
+        }
+
+        std::vector<ViewDescriptor> take_batch_read() {
+            return std::move(*std::get_if<std::vector<ViewDescriptor>>(&op));
+        }
+
+        std::promise<std::vector<std::optional<View>>> take_batch_read_res() {
+            return std::move(*std::get_if<std::promise<std::vector<std::optional<View>>>>(&res));
+        }
+
+        bool is_column_read() {
+            return std::holds_alternative<ColumnRequest>(op);
+        }
+
+        ColumnRequest take_column_read() {
+            return std::move(*std::get_if<ColumnRequest>(&op));
+        }
+
+        std::promise<ColumnarView> take_column_read_res() {
+            return std::move(*std::get_if<std::promise<ColumnarView>>(&res));
+        }
+
+        bool is_waiting_read() {
+            return std::holds_alternative<WaitingRead>(op);
+        }
+
+        WaitingRead take_waiting_read() {
+            return std::move(*std::get_if<WaitingRead>(&op));
+        }
+
+        bool is_task() {
+            return std::holds_alternative<Task>(op);
+        }
+
+        Task take_task() {
+            return std::move(*std::get_if<Task>(&op));
+        }
+
+        std::promise<void> take_task_res() {
+            return std::move(*std::get_if<std::promise<void> >(&res));
+        }
     };
 
 
     using EventPublishCallback = std::function<void(Event &&evt)>;
     using ViewReadCallback = std::function<const std::optional<View> (const ViewDescriptor &view_desc)>;
+    using ColumnReadCallback = std::function<ColumnarView (const ColumnRequest &req)>;
 
 
     template<std::uint32_t NumThreads>
     class OpDispatch {
 
     public:
-        OpDispatch(EventPublishCallback pub, ViewReadCallback read) : pub_{std::move(pub)}, read_{std::move(read)},
+        OpDispatch(EventPublishCallback pub, ViewReadCallback read, ColumnReadCallback columns = {},
+                   bool coalesce_reads = false) :
+        pub_{std::move(pub)}, read_{std::move(read)}, columns_{std::move(columns)}, coalesce_{coalesce_reads},
         running_{true}, worker_{ [&]{ work(); } }  {}
 
         OpDispatch(const OpDispatch &) = delete;
@@ -92,12 +159,105 @@ namespace eventview {
             return std::move(result);
         }
 
+        /*
+         * With coalescing on, identical descriptors that arrive while a read for them is still queued join that read
+         * instead of queueing their own, and every caller gets the view it produces. The shared read has not finished
+         * when a caller joins and writes are applied on the same worker, so nobody is handed a view older than their
+         * call. Joining costs every read a lock, a hash of the whole descriptor and a copy of it, so it only pays off
+         * when many callers ask for the same hot views and is off by default.
+         */
         std::future<std::optional<View>> read_view(ViewDescriptor desc) {
             std::promise<std::optional<View>> p{};
             auto result = p.get_future();
 
+            if (!coalesce_) {
+                Operation op{ std::move(desc), std::move(p) };
+                mpsc_.produce(std::move(op));
+                return std::move(result);
+            }
+
+            const ViewDescriptor *key = nullptr;
+            {
+                std::lock_guard<std::mutex> lock{in_flight_mutex_};
+                auto found = in_flight_.find(desc);
+                if (found != in_flight_.end()) {
+                    found->second.push_back(std::move(p));
+                    coalesced_.fetch_add(1, std::memory_order_relaxed);
+                    return std::move(result);
+                }
+                //nodes are stable, so the key stays put for abandon_read while the entry is in the map
+                key = &in_flight_.emplace(desc, std::vector<std::promise<std::optional<View>>>{}).first->first;
+            }
+
             Operation op{ std::move(desc), std::move(p) };
 
+            if (!mpsc_.produce(std::move(op))) {
+                abandon_read(*key);
+            }
+
+            return std::move(result);
+        }
+
+        /*
+         * Like read_view, but when the descriptor's expectation is not met yet the worker parks the read until a
+         * publish at or after minimum_write touches the expected entity, or until the wait elapses.
+         */
+        std::future<std::optional<View>> read_view(ViewDescriptor desc, std::chrono::milliseconds wait) {
+            std::promise<std::optional<View>> p{};
+            auto result = p.get_future();
+
+            Operation op{ WaitingRead{std::move(desc), std::chrono::steady_clock::now() + wait}, std::move(p) };
+
+            mpsc_.produce(std::move(op));
+
+            return std::move(result);
+        }
+
+        //evaluates every descriptor back to back on the worker for the cost of one queued operation
+        std::future<std::vector<std::optional<View>>> read_views(std::vector<ViewDescriptor> descs) {
+            std::promise<std::vector<std::optional<View>>> p{};
+            auto result = p.get_future();
+
+            Operation op{ std::move(descs), std::move(p) };
+
+            mpsc_.produce(std::move(op));
+
+            return std::move(result);
+        }
+
+        std::future<void> run_task(Task task) {
+            std::promise<void> p{};
+            auto result = p.get_future();
+
+            Operation op{ std::move(task), std::move(p) };
+
+            mpsc_.produce(std::move(op));
+
+            return std::move(result);
+        }
+
+        //retries every parked read; only for tasks on the worker that change the store without publishing
+        void wake_all_waiters() {
+            std::vector<EntityDescriptor> expected{};
+            for (auto &entry : waiters_) {
+                expected.push_back(entry.first);
+            }
+            for (auto &entity : expected) {
+                wake_waiters(entity, std::numeric_limits<EventID>::max());
+            }
+        }
+
+        //reads answered by joining an identical queued read rather than running their own
+        std::uint64_t coalesced_reads() const {
+            return coalesced_.load(std::memory_order_relaxed);
+        }
+
+        std::future<ColumnarView> read_columns(ColumnRequest req) {
+            std::promise<ColumnarView> p{};
+            auto result = p.get_future();
+
+            Operation op{ std::move(req), std::move(p) };
+
             mpsc_.produce(std::move(op));
 
             return std::move(result);
@@ -106,6 +266,31 @@ namespace eventview {
 
     private:
 
+        struct Waiter {
+            ViewDescriptor desc;
+            std::chrono::steady_clock::time_point deadline;
+            std::promise<std::optional<View>> res;
+        };
+
+        /*
+         * A read the full queue dropped never reaches the worker, so its entry is taken back out here and the reads
+         * that joined it fail, rather than every later identical read joining it and waiting forever.
+         */
+        void abandon_read(const ViewDescriptor &key) {
+            std::vector<std::promise<std::optional<View>>> joined{};
+            {
+                std::lock_guard<std::mutex> lock{in_flight_mutex_};
+                auto found = in_flight_.find(key);
+                joined = std::move(found->second);
+                in_flight_.erase(found);
+            }
+
+            auto full = std::make_exception_ptr(std::runtime_error{"dispatch queue full, read dropped"});
+            for (auto &waiter : joined) {
+                waiter.set_exception(full);
+            }
+        }
+
         void work() {
             try {
                 while (running_.load(std::memory_order_consume)) {
@@ -114,7 +299,11 @@ namespace eventview {
                         process_op(std::move(*op));
                     } else {
                         //need backoff strategy
-                        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                        std::this_thread::sleep_for(idle_wait());
+                    }
+
+                    if (waiting_ > 0) {
+                        expire_waiters();
                     }
                 }
             } catch (...) {
@@ -122,25 +311,209 @@ namespace eventview {
             }
         }
 
+        std::chrono::steady_clock::duration idle_wait() const {
+            std::chrono::steady_clock::duration wait = std::chrono::milliseconds(250);
+
+            if (waiting_ > 0) {
+                auto until_deadline = next_deadline_ - std::chrono::steady_clock::now();
+                if (until_deadline < wait) {
+                    wait = until_deadline;
+                }
+            }
+
+            return wait;
+        }
+
+        void park(Waiter waiter) {
+            if (waiting_ == 0 || waiter.deadline < next_deadline_) {
+                next_deadline_ = waiter.deadline;
+            }
+
+            auto key = waiter.desc.expectation->expected;
+            waiters_[key].push_back(std::move(waiter));
+            ++waiting_;
+        }
+
+        void process_waiting_read(WaitingRead &&read, std::promise<std::optional<View>> res) {
+            try {
+                auto resp = read_(read.desc);
+                if (resp || !read.desc.expectation || read.deadline <= std::chrono::steady_clock::now()) {
+                    res.set_value(std::move(resp));
+                } else {
+                    park(Waiter{std::move(read.desc), read.deadline, std::move(res)});
+                }
+            } catch (...) {
+                res.set_exception(std::current_exception());
+            }
+        }
+
+        //retries the reads parked on an entity the event touched, if the event is late enough to satisfy them
+        void wake_waiters(const EntityDescriptor &touched, EventID evt_id) {
+            auto found = waiters_.find(touched);
+            if (found == waiters_.end()) {
+                return;
+            }
+
+            auto &parked = found->second;
+            for (auto i = parked.begin(); i != parked.end();) {
+                if (i->desc.expectation->minimum_write > evt_id) {
+                    ++i;
+                    continue;
+                }
+
+                try {
+                    auto resp = read_(i->desc);
+                    if (!resp) {
+                        ++i;
+                        continue;
+                    }
+                    i->res.set_value(std::move(resp));
+                } catch (...) {
+                    i->res.set_exception(std::current_exception());
+                }
+
+                i = parked.erase(i);
+                --waiting_;
+            }
+
+            if (parked.empty()) {
+                waiters_.erase(found);
+            }
+        }
+
+        //completes parked reads whose wait elapsed with one last attempt, so a missed wakeup only costs latency
+        void expire_waiters() {
+            auto now = std::chrono::steady_clock::now();
+            if (now < next_deadline_) {
+                return;
+            }
+
+            auto next = std::chrono::steady_clock::time_point::max();
+
+            for (auto entry = waiters_.begin(); entry != waiters_.end();) {
+                auto &parked = entry->second;
+
+                for (auto i = parked.begin(); i != parked.end();) {
+                    if (i->deadline > now) {
+                        next = std::min(next, i->deadline);
+                        ++i;
+                        continue;
+                    }
+
+                    try {
+                        i->res.set_value(read_(i->desc));
+                    } catch (...) {
+                        i->res.set_exception(std::current_exception());
+                    }
+
+                    i = parked.erase(i);
+                    --waiting_;
+                }
+
+                entry = parked.empty() ? waiters_.erase(entry) : std::next(entry);
+            }
+
+            next_deadline_ = next;
+        }
+
         void process_op(Operation &&op) {
             if (op.is_read()) {
                 const auto& desc = op.take_read();
                 auto view = op.take_read_res();
+                std::optional<View> resp{};
+                std::exception_ptr failed{};
                 try {
-                    auto& resp = read_(desc);
+                    resp = read_(desc);
+                } catch (...) {
+                    failed = std::current_exception();
+                }
+
+                //callers that join from here on queue a fresh read
+                std::vector<std::promise<std::optional<View>>> joined{};
+                if (coalesce_) {
+                    std::lock_guard<std::mutex> lock{in_flight_mutex_};
+                    auto found = in_flight_.find(desc);
+                    if (found != in_flight_.end()) {
+                        joined = std::move(found->second);
+                        in_flight_.erase(found);
+                    }
+                }
+
+                for (auto &waiter : joined) {
+                    if (failed) {
+                        waiter.set_exception(failed);
+                    } else {
+                        waiter.set_value(resp);
+                    }
+                }
+
+                if (failed) {
+                    view.set_exception(failed);
+                } else {
                     view.set_value(std::move(resp));
+                }
+            } else if (op.is_batch_read()) {
+                const auto& descs = op.take_batch_read();
+                auto views = op.take_batch_read_res();
+                std::vector<std::optional<View>> resp{};
+                resp.reserve(descs.size());
+
+                for (auto &desc : descs) {
+                    try {
+                        resp.push_back(read_(desc));
+                    } catch (...) {
+                        //a bad descriptor only fails its own slot in the batch
+                        resp.emplace_back();
+                    }
+                }
+
+                views.set_value(std::move(resp));
+            } else if (op.is_column_read()) {
+                const auto& req = op.take_column_read();
+                auto cols = op.take_column_read_res();
+                try {
+                    cols.set_value(columns_(req));
+                } catch (...) {
+                    cols.set_exception(std::current_exception());
+                }
+            } else if (op.is_task()) {
+                auto task = op.take_task();
+                auto done = op.take_task_res();
+                try {
+                    task();
+                    done.set_value();
                 } catch (...) {
-                    view.set_exception(std::current_exception());
+                    done.set_exception(std::current_exception());
                 }
+            } else if (op.is_waiting_read()) {
+                auto read = op.take_waiting_read();
+                process_waiting_read(std::move(read), op.take_read_res());
             } else if (op.is_write()) {
                 auto evt = op.take_write();
                 auto ok = op.take_write_res();
+
+                std::vector<EntityDescriptor> touched{};
+                auto evt_id = evt.id;
+                if (waiting_ > 0) {
+                    //the written entity and everything it references get their write time bumped
+                    touched.push_back(evt.entity.descriptor());
+                    for (auto &kv : evt.entity.fields()) {
+                        if (kv.second.is_descriptor()) {
+                            touched.push_back(kv.second.as_descriptor());
+                        }
+                    }
+                }
+
                 try {
                     pub_(std::move(evt));
                     ok.set_value();
                 } catch (...) {
                     ok.set_exception(std::current_exception());
                 }
+
+                for (auto &desc : touched) {
+                    wake_waiters(desc, evt_id);
+                }
             } else {
                 throw(std::logic_error("unexpected operation type in dispatcher"));
             }
@@ -148,9 +521,18 @@ namespace eventview {
 
         EventPublishCallback pub_;
         ViewReadCallback read_;
+        ColumnReadCallback columns_;
+        bool coalesce_;
         MPSC<Operation, NumThreads> mpsc_;
-        std::thread worker_;
+        std::unordered_map<EntityDescriptor, std::vector<Waiter>> waiters_;
+        std::size_t waiting_{0};
+        std::chrono::steady_clock::time_point next_deadline_{};
+        std::mutex in_flight_mutex_;
+        std::unordered_map<ViewDescriptor, std::vector<std::promise<std::optional<View>>>> in_flight_;
+        std::atomic<std::uint64_t> coalesced_{0};
+        //declared ahead of worker_ so the worker never observes it uninitialised
         std::atomic<bool> running_;
+        std::thread worker_;
     };
 
 }
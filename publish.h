@@ -11,6 +11,7 @@
 
 #include "types.h"
 #include "opdispatch.h"
+#include "publishimpl.h"
 
 namespace eventview {
 
@@ -48,7 +49,8 @@ namespace eventview {
     class Publisher {
 
     public:
-        explicit Publisher(std::shared_ptr<OpDispatch<NumThreads>> dispatch) : dispatch_{dispatch} {}
+        explicit Publisher(std::shared_ptr<OpDispatch<NumThreads>> dispatch,
+                           std::shared_ptr<PublisherImpl> impl = nullptr) : dispatch_{dispatch}, impl_{impl} {}
 
         Publisher(const Publisher &other) = delete;
 
@@ -62,8 +64,43 @@ namespace eventview {
 
         inline PublishResult publish(Event &&evt) noexcept ;
 
+        /*
+         * Loads the events of a log's chunks straight into the store on startup, decoding and applying them from
+         * up to threads threads, in place of publishing them one at a time. The store must still be empty.
+         * Subscriptions are re-evaluated and parked reads retried once the load is in.
+         * Returns the number of events applied, or nothing if the replay failed.
+         */
+        inline std::optional<std::size_t> bulk_replay(const std::vector<LogPosition> &chunks,
+                                                      std::size_t threads = 4) noexcept;
+
+        /*
+         * Replays a log into the empty store on startup, publishing only the newest version of each entity in full
+         * and just the reference changes of the versions it supersedes. Parked reads are retried once the log is
+         * in. Returns nothing if the replay failed.
+         */
+        template<typename Storage>
+        std::optional<ReplayStats> replay_latest(const Storage &storage) noexcept {
+            if (!impl_) {
+                return {};
+            }
+
+            try {
+                auto impl = impl_;
+                ReplayStats stats{};
+                dispatch_->run_task([&, impl]() {
+                    stats = impl->replay_latest(storage);
+                    //nothing went through publish_event, so no read parked on the replayed ids was woken
+                    dispatch_->wake_all_waiters();
+                }).get();
+                return stats;
+            } catch (...) {
+                return {};
+            }
+        }
+
     private:
         std::shared_ptr<OpDispatch<NumThreads>> dispatch_;
+        std::shared_ptr<PublisherImpl> impl_;
     };
 
     template<std::uint32_t NumThreads>
@@ -79,6 +116,27 @@ namespace eventview {
             return PublishResult{"unexpected exception"};
         }
     }
+
+    template<std::uint32_t NumThreads>
+    inline std::optional<std::size_t> Publisher<NumThreads>::bulk_replay(const std::vector<LogPosition> &chunks,
+                                                                         std::size_t threads) noexcept {
+        if (!impl_) {
+            return {};
+        }
+
+        try {
+            auto impl = impl_;
+            std::size_t applied = 0;
+            dispatch_->run_task([&, impl]() {
+                applied = impl->bulk_replay(chunks, threads);
+                //no publish went through the dispatcher to wake reads parked on what was loaded
+                dispatch_->wake_all_waiters();
+            }).get();
+            return applied;
+        } catch (...) {
+            return {};
+        }
+    }
 }
 
 #endif //EVENTVIEW_PUBLISH_H
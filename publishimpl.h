@@ -13,13 +13,22 @@
 
 #include "types.h"
 #include "entitystorage.h"
+#include "viewcache.h"
+#include "subscriptions.h"
+#include "fieldindex.h"
+#include "bulkreplay.h"
+#include "replayfilter.h"
 
 namespace eventview {
 
     class PublisherImpl {
 
     public:
-        explicit PublisherImpl(std::shared_ptr<EntityStore> store) : store_{std::move(store)} {}
+        explicit PublisherImpl(std::shared_ptr<EntityStore> store, std::shared_ptr<ViewCache> cache = nullptr,
+                               std::shared_ptr<SubscriptionRegistry> subscriptions = nullptr,
+                               std::shared_ptr<FieldIndexes> indexes = nullptr) :
+                store_{std::move(store)}, cache_{std::move(cache)}, subscriptions_{std::move(subscriptions)},
+                indexes_{std::move(indexes)} {}
 
         PublisherImpl(const PublisherImpl &other) = delete;
 
@@ -34,45 +43,228 @@ namespace eventview {
 
         inline void publish(Event &&evt);
 
+        //fills the empty store from log chunks in parallel, then indexes what it loaded
+        inline std::size_t bulk_replay(const std::vector<LogPosition> &chunks, std::size_t threads);
+
+        /*
+         * Replays a log into the empty store in two passes. The first finds the newest version of every entity;
+         * the second publishes those in full and, of the versions they supersede, only the reference changes, so
+         * the reverse refs and stubs match a full replay of a log in EventID order without storing fields that
+         * would be overwritten. When ids go backwards, as several writers sharing a file leave them, a ref logged
+         * ahead of an older version can decide which version wins; the entities where that happens are published
+         * in full and counted in ReplayStats::unordered.
+         */
+        template<typename Storage>
+        ReplayStats replay_latest(const Storage &storage);
+
     private:
 
         inline void reference_stub(EntityDescriptor stub, EventID ref_time,
                                    const std::string &field, EntityDescriptor ref, bool add_ref);
 
+        inline void add_reference(const EntityDescriptor &target, EventID ref_time, const std::string &field,
+                                  const EntityDescriptor &ref);
+
+        inline void remove_reference(const EntityDescriptor &target, EventID ref_time, const std::string &field,
+                                     const EntityDescriptor &ref);
+
+        //removes the refs of the version evt replaces that evt doesn't keep, as putting evt over it would
+        inline void remove_replaced(const ReplayedVersion &replaced, const Event &evt);
+
+        inline void touched_node(const EntityDescriptor &node);
+
+        inline void touched_reverse_field(const EntityDescriptor &node, const std::string &field);
+
         std::shared_ptr<EntityStore> store_;
+        std::shared_ptr<ViewCache> cache_;
+        std::shared_ptr<SubscriptionRegistry> subscriptions_;
+        std::shared_ptr<FieldIndexes> indexes_;
     };
 
     inline void PublisherImpl::publish(Event &&evt) {
+        auto &written = evt.entity.descriptor();
+        auto index = indexes_ && indexes_->indexed(written.type);
+
+        Entity::Fields before{};
+        if (index) {
+            const auto &existing = store_->get(written);
+            if (existing) {
+                before = indexes_->snapshot(existing->get());
+            }
+        }
+
         auto result = store_->put(evt.id, evt.entity);
+        touched_node(written);
+
+        if (index) {
+            //compares against what the store kept, so a write that lost under LWW leaves the index alone
+            const auto &stored = store_->get(written);
+            if (stored) {
+                indexes_->update(written, before, stored->get());
+            }
+        }
 
         //remove old referencers
         for (auto &kv : result) {
-            const auto &lookup = store_->get(kv.second);
-            if (lookup) {
-                auto &node = lookup->get();
-                node.remove_referencer(evt.id, kv.first, evt.entity.descriptor());
-            } else {
-                //need to add stub storage node for not-yet existent entity and remove ref it
-                reference_stub(kv.second, evt.id, kv.first, evt.entity.descriptor(), false);
+            auto kept = evt.entity.fields().find(kv.first);
+            if (kept != evt.entity.fields().end() && kept->second.is_descriptor() &&
+                kept->second.as_descriptor() == kv.second) {
+                //still referenced; removing and re-adding at the same write time would leave the edge dead
+                continue;
             }
+
+            remove_reference(kv.second, evt.id, kv.first, evt.entity.descriptor());
         }
 
         //add new referencers
         for (auto &kv : evt.entity.fields()) {
             if (kv.second.is_descriptor()) {
-                auto &desc = kv.second.as_descriptor();
-
-                const auto &lookup = store_->get(desc);
-                if (lookup) {
-                    auto &node = lookup->get();
-                    node.add_referencer(evt.id, kv.first, evt.entity.descriptor());
-                } else {
-                    //need to add stub storage node for not-yet existent entity and ref it
-                    reference_stub(desc, evt.id, kv.first, evt.entity.descriptor(), true);
+                add_reference(kv.second.as_descriptor(), evt.id, kv.first, evt.entity.descriptor());
+            }
+        }
+
+        if (subscriptions_) {
+            subscriptions_->notify(evt.id);
+        }
+    }
+
+    inline std::size_t PublisherImpl::bulk_replay(const std::vector<LogPosition> &chunks, std::size_t threads) {
+        if (store_->size() > 0) {
+            throw std::logic_error{"bulk replay needs an empty store"};
+        }
+
+        auto result = BulkReplay{threads}.run(chunks, *store_);
+
+        if (indexes_) {
+            for (auto &desc : result.entities) {
+                const auto &stored = store_->get(desc);
+                if (stored && indexes_->indexed(desc.type)) {
+                    indexes_->update(desc, {}, stored->get());
                 }
             }
         }
 
+        /*
+         * Nothing is cached for an empty store, since there are no views to cache, but subscriptions may already
+         * depend on roots that did not exist yet. The load bypasses publish, so every one of them is re-evaluated.
+         */
+        if (subscriptions_) {
+            subscriptions_->touched_all();
+            subscriptions_->notify(result.latest);
+        }
+
+        return result.events;
+    }
+
+    template<typename Storage>
+    ReplayStats PublisherImpl::replay_latest(const Storage &storage) {
+        if (store_->size() > 0) {
+            throw std::logic_error{"replay needs an empty store"};
+        }
+
+        LatestVersions latest{};
+        EventID last = 0;
+        bool ordered = true;
+        for (auto &evt : storage) {
+            latest.record(evt.entity.descriptor().id, evt.id);
+            ordered = ordered && evt.id >= last;
+            last = evt.id;
+        }
+
+        //only a log whose ids go backwards can have versions decided by refs, so only it needs the dry run
+        UnorderedVersions unordered{};
+        if (!ordered) {
+            for (auto &evt : storage) {
+                unordered.record(evt);
+            }
+        }
+
+        ReplayStats stats{};
+        stats.unordered = unordered.size();
+        //entities with more than one version, until their newest is published
+        std::unordered_map<EntityID, ReplayedVersion> seen{};
+        for (auto &stored : storage) {
+            auto id = stored.entity.descriptor().id;
+            if (latest.versions(id) < 2 || unordered.unordered(id)) {
+                publish(Event{stored});
+                ++stats.applied;
+                continue;
+            }
+
+            auto newest = latest.latest(id);
+            auto &replayed = seen[id];
+            if (replayed.id == newest) {
+                //an older version logged after the newest loses under LWW, exactly as it would in a full replay
+                publish(Event{stored});
+                ++stats.applied;
+                continue;
+            }
+
+            if (stored.id == newest) {
+                //the store never held the versions before this one, so the refs it replaces are removed here
+                remove_replaced(replayed, stored);
+                publish(Event{stored});
+                replayed = ReplayedVersion{newest, {}};
+                ++stats.applied;
+                continue;
+            }
+
+            auto &referencer = stored.entity.descriptor();
+            if (stored.id > replayed.id) {
+                remove_replaced(replayed, stored);
+                replayed.id = stored.id;
+                replayed.refs.clear();
+                for (auto &kv : stored.entity.fields()) {
+                    if (kv.second.is_descriptor()) {
+                        replayed.refs.emplace_back(kv.first, kv.second.as_descriptor());
+                    }
+                }
+            }
+
+            for (auto &kv : stored.entity.fields()) {
+                if (kv.second.is_descriptor()) {
+                    add_reference(kv.second.as_descriptor(), stored.id, kv.first, referencer);
+                }
+            }
+            ++stats.skipped;
+        }
+
+        return stats;
+    }
+
+    inline void PublisherImpl::remove_replaced(const ReplayedVersion &replaced, const Event &evt) {
+        auto &fields = evt.entity.fields();
+        for (auto &ref : replaced.refs) {
+            auto kept = fields.find(ref.first);
+            if (kept != fields.end() && kept->second.is_descriptor() && kept->second.as_descriptor() == ref.second) {
+                continue;
+            }
+            remove_reference(ref.second, evt.id, ref.first, evt.entity.descriptor());
+        }
+    }
+
+    inline void PublisherImpl::add_reference(const EntityDescriptor &target, EventID ref_time,
+                                             const std::string &field, const EntityDescriptor &ref) {
+        const auto &lookup = store_->get(target);
+        if (lookup) {
+            lookup->get().add_referencer(ref_time, field, ref);
+            touched_reverse_field(target, field);
+        } else {
+            //need to add stub storage node for not-yet existent entity and ref it
+            reference_stub(target, ref_time, field, ref, true);
+        }
+    }
+
+    inline void PublisherImpl::remove_reference(const EntityDescriptor &target, EventID ref_time,
+                                                const std::string &field, const EntityDescriptor &ref) {
+        const auto &lookup = store_->get(target);
+        if (lookup) {
+            lookup->get().remove_referencer(ref_time, field, ref);
+            touched_reverse_field(target, field);
+        } else {
+            //need to add stub storage node for not-yet existent entity and remove ref it
+            reference_stub(target, ref_time, field, ref, false);
+        }
     }
 
     inline void PublisherImpl::reference_stub(EntityDescriptor stub, EventID ref_time,
@@ -86,6 +278,27 @@ namespace eventview {
         } else {
             node->get().remove_referencer(ref_time, field, ref);
         }
+
+        touched_node(stub);
+        touched_reverse_field(stub, field);
+    }
+
+    inline void PublisherImpl::touched_node(const EntityDescriptor &node) {
+        if (cache_) {
+            cache_->invalidate_node(node);
+        }
+        if (subscriptions_) {
+            subscriptions_->touched_node(node);
+        }
+    }
+
+    inline void PublisherImpl::touched_reverse_field(const EntityDescriptor &node, const std::string &field) {
+        if (cache_) {
+            cache_->invalidate_reverse_field(node, field);
+        }
+        if (subscriptions_) {
+            subscriptions_->touched_reverse_field(node, field);
+        }
     }
 
 }
@@ -0,0 +1,179 @@
+
+#ifndef EVENTVIEW_REPLAYFILTER_H
+#define EVENTVIEW_REPLAYFILTER_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+
+namespace eventview {
+
+    struct ReplayStats {
+        //events published in full
+        std::size_t applied = 0;
+        //superseded events of which only the reference changes were applied
+        std::size_t skipped = 0;
+        //entities published in full because refs logged out of order decided which of their versions won
+        std::size_t unordered = 0;
+    };
+
+    /*
+     * The newest EventID and number of versions of every entity in a log, gathered by a first pass over it so
+     * that a second pass can publish only each entity's newest version. Kept in one flat open addressing table
+     * rather than a node per entity, since the first pass sees every entity in the log.
+     */
+    class LatestVersions final {
+    public:
+        explicit LatestVersions(std::size_t expected = 1024) : slots_(capacity_for(expected)), size_{0} {}
+
+        void record(EntityID entity, EventID evt_id) {
+            auto &slot = slots_[probe(entity)];
+            if (slot.versions == 0) {
+                slot = Slot{entity, evt_id, 1};
+                if (++size_ * 2 > slots_.size()) {
+                    grow();
+                }
+                return;
+            }
+
+            ++slot.versions;
+            if (evt_id > slot.latest) {
+                slot.latest = evt_id;
+            }
+        }
+
+        //the newest EventID recorded for the entity, or 0 if it has none
+        EventID latest(EntityID entity) const {
+            return slots_[probe(entity)].latest;
+        }
+
+        std::uint32_t versions(EntityID entity) const {
+            return slots_[probe(entity)].versions;
+        }
+
+        std::size_t size() const {
+            return size_;
+        }
+
+    private:
+        struct Slot {
+            EntityID entity;
+            EventID latest;
+            std::uint32_t versions;
+        };
+
+        static std::size_t capacity_for(std::size_t expected) {
+            std::size_t capacity = 16;
+            while (capacity < expected * 2) {
+                capacity <<= 1u;
+            }
+            return capacity;
+        }
+
+        std::size_t probe(EntityID entity) const {
+            auto mask = slots_.size() - 1;
+            //snowflake ids share their high bits, so mix before masking
+            auto idx = static_cast<std::size_t>(entity * 0x9E3779B97F4A7C15ull >> 32u) & mask;
+            while (slots_[idx].versions != 0 && slots_[idx].entity != entity) {
+                idx = (idx + 1) & mask;
+            }
+            return idx;
+        }
+
+        void grow() {
+            std::vector<Slot> old(slots_.size() * 2);
+            old.swap(slots_);
+            for (auto &slot : old) {
+                if (slot.versions != 0) {
+                    slots_[probe(slot.entity)] = slot;
+                }
+            }
+        }
+
+        std::vector<Slot> slots_;
+        std::size_t size_;
+    };
+
+    //the reference fields of the version of an entity a replay last applied, and when it was written
+    struct ReplayedVersion {
+        EventID id = 0;
+        std::vector<std::pair<std::string, EntityDescriptor>> refs{};
+    };
+
+    /*
+     * Finds the entities of a log whose versions a replay cannot skip. Skipping assumes a version is applied
+     * exactly when it is newer than the versions of its entity logged before it, but a full replay also rejects
+     * a version older than any ref added to or removed from the entity before it was logged, which only happens
+     * once ids go backwards. Record every event in log order to dry run a full replay that keeps just write times
+     * and refs; an entity is unordered if a ref ever rejected one of its versions.
+     */
+    class UnorderedVersions final {
+    public:
+        void record(const Event &evt) {
+            auto &entity = evt.entity.descriptor();
+            auto &node = nodes_[entity.id];
+            auto rejected = node.write_time >= evt.id;
+            if (rejected != (node.newest >= evt.id)) {
+                unordered_.insert(entity.id);
+            }
+            if (evt.id > node.newest) {
+                node.newest = evt.id;
+            }
+
+            std::vector<std::pair<std::string, EntityDescriptor>> refs{};
+            for (auto &kv : evt.entity.fields()) {
+                if (kv.second.is_descriptor()) {
+                    refs.emplace_back(kv.first, kv.second.as_descriptor());
+                }
+            }
+
+            if (!rejected) {
+                node.write_time = evt.id;
+                //the refs the version replaces and doesn't keep are removed, touching their targets
+                for (auto &ref : node.refs) {
+                    if (std::find(refs.begin(), refs.end(), ref) == refs.end()) {
+                        touch(ref.second.id, evt.id);
+                    }
+                }
+                node.refs = refs;
+            }
+            for (auto &ref : refs) {
+                touch(ref.second.id, evt.id);
+            }
+        }
+
+        bool unordered(EntityID entity) const {
+            return unordered_.count(entity) > 0;
+        }
+
+        std::size_t size() const {
+            return unordered_.size();
+        }
+
+    private:
+        struct Node {
+            //newest write time of the entity, its refs included; a stub starts at 1
+            EventID write_time = 0;
+            //newest of its own versions
+            EventID newest = 0;
+            //refs of the version a full replay would hold
+            std::vector<std::pair<std::string, EntityDescriptor>> refs{};
+        };
+
+        void touch(EntityID entity, EventID ref_time) {
+            auto &node = nodes_[entity];
+            node.write_time = std::max(node.write_time, std::max<EventID>(ref_time, 1));
+        }
+
+        std::unordered_map<EntityID, Node> nodes_{};
+        std::unordered_set<EntityID> unordered_{};
+    };
+
+}
+
+#endif //EVENTVIEW_REPLAYFILTER_H
@@ -0,0 +1,283 @@
+
+#ifndef EVENTVIEW_SEGMENTEDLOG_H
+#define EVENTVIEW_SEGMENTEDLOG_H
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "snowflake.h"
+#include "filelog.h"
+
+namespace eventview {
+
+    struct SegmentedLogOptions {
+        LogFileOptions file{};
+        //the active segment is sealed once it holds this many bytes
+        std::uint64_t segment_bytes = 64u << 20u;
+        //or once an event would stretch it over this much time by snowflake timestamp; zero for no time bound
+        std::chrono::milliseconds segment_span{0};
+    };
+
+    /*
+     * An event log split into numbered segment files in one directory. Only the newest segment is appended to;
+     * the rest are sealed, and each is known by the sparse restart index of its file. Replay from an EventID
+     * skips whole segments and binary searches into the first one it needs, and old history is trimmed by
+     * deleting whole sealed segments.
+     */
+    class SegmentedLog final {
+    public:
+        inline explicit SegmentedLog(std::string directory, SegmentedLogOptions options = {});
+
+        SegmentedLog(const SegmentedLog &) = delete;
+
+        SegmentedLog &operator=(const SegmentedLog &) = delete;
+
+        ~SegmentedLog() = default;
+
+        inline void append(const Event &evt);
+
+        //seals the active segment and starts a new one
+        inline void roll();
+
+        //where to read for the events with ids from the given one on, oldest segment first
+        inline std::vector<LogPosition> positions(EventID from) const;
+
+        //every segment in independently decodable pieces, for a parallel bulk replay
+        inline std::vector<LogPosition> chunks() const;
+
+        template<typename Visitor>
+        void replay_from(EventID from, Visitor &&visitor) const {
+            for (auto i = LogIterator{positions(from), from}; i != LogIterator{}; ++i) {
+                visitor(Event{*i});
+            }
+        }
+
+        //deletes the oldest sealed segments holding only events with ids below the given one
+        inline std::size_t drop_before(EventID id);
+
+        std::size_t segment_count() const {
+            std::shared_lock<std::shared_mutex> lock{mutex_};
+            return sealed_.size() + 1;
+        }
+
+    private:
+        struct Segment {
+            std::string path;
+            LogFileIndex index;
+        };
+
+        std::string segment_path(std::uint64_t number) const {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%020llu.log", static_cast<unsigned long long>(number));
+            return (std::filesystem::path{directory_} / name).string();
+        }
+
+        inline bool full(const LogFile &active, const Event &evt) const;
+
+        //seals active if it is still the active segment; callers hold no lock
+        inline void roll(const std::shared_ptr<LogFile> &active);
+
+        std::string directory_;
+        SegmentedLogOptions options_;
+
+        //shared while appending or reading positions, exclusive while rolling or dropping segments
+        mutable std::shared_mutex mutex_;
+        std::vector<Segment> sealed_;
+        std::uint64_t active_number_;
+        std::shared_ptr<LogFile> active_;
+    };
+
+    inline SegmentedLog::SegmentedLog(std::string directory, SegmentedLogOptions options) :
+            directory_{std::move(directory)}, options_{options}, active_number_{1} {
+        if (options_.segment_bytes == 0) {
+            //every append would find the empty active segment full and roll it forever
+            throw std::invalid_argument{"segment_bytes must be greater than zero"};
+        }
+
+        std::filesystem::create_directories(directory_);
+
+        std::vector<std::uint64_t> numbers{};
+        for (auto &entry : std::filesystem::directory_iterator{directory_}) {
+            auto &file = entry.path();
+            if (!entry.is_regular_file() || file.extension() != ".log") {
+                continue;
+            }
+
+            //other .log files may share the directory; only numbered ones are segments
+            auto stem = file.stem().string();
+            std::uint64_t number = 0;
+            auto parsed = std::from_chars(stem.data(), stem.data() + stem.size(), number);
+            if (parsed.ec == std::errc{} && parsed.ptr == stem.data() + stem.size()) {
+                numbers.push_back(number);
+            }
+        }
+        std::sort(numbers.begin(), numbers.end());
+
+        if (!numbers.empty()) {
+            active_number_ = numbers.back();
+            numbers.pop_back();
+        }
+
+        for (auto number : numbers) {
+            EventDecoder decoder{};
+            auto path = segment_path(number);
+            sealed_.push_back(Segment{path, LogFile::scan(path, decoder)});
+        }
+
+        active_ = std::make_shared<LogFile>(segment_path(active_number_), options_.file);
+    }
+
+    inline void SegmentedLog::append(const Event &evt) {
+        while (true) {
+            std::shared_ptr<LogFile> active{};
+            {
+                std::shared_lock<std::shared_mutex> lock{mutex_};
+                if (!full(*active_, evt)) {
+                    active_->append(evt);
+                    return;
+                }
+                active = active_;
+            }
+
+            roll(active);
+        }
+    }
+
+    inline bool SegmentedLog::full(const LogFile &active, const Event &evt) const {
+        if (active.bytes() >= options_.segment_bytes) {
+            return true;
+        }
+        if (options_.segment_span.count() == 0) {
+            return false;
+        }
+
+        auto first = active.min_id();
+        if (!first) {
+            return false;
+        }
+
+        SnowflakeIDPacker packer{};
+        auto start = std::get<0>(packer.unpack(*first));
+        auto at = std::get<0>(packer.unpack(evt.id));
+        return at > start && at - start >= static_cast<std::uint64_t>(options_.segment_span.count());
+    }
+
+    inline void SegmentedLog::roll() {
+        std::shared_ptr<LogFile> active{};
+        {
+            std::shared_lock<std::shared_mutex> lock{mutex_};
+            active = active_;
+        }
+        roll(active);
+    }
+
+    inline void SegmentedLog::roll(const std::shared_ptr<LogFile> &active) {
+        std::unique_lock<std::shared_mutex> lock{mutex_};
+        if (active_ != active || active_->bytes() == 0) {
+            return;
+        }
+
+        active_->flush();
+        sealed_.push_back(Segment{active_->path(), active_->index()});
+        active_ = std::make_shared<LogFile>(segment_path(++active_number_), options_.file);
+    }
+
+    inline std::vector<LogPosition> SegmentedLog::positions(EventID from) const {
+        std::vector<LogPosition> positions{};
+
+        std::shared_lock<std::shared_mutex> lock{mutex_};
+        for (auto &segment : sealed_) {
+            if (segment.index.records > 0 && segment.index.max_id >= from) {
+                positions.push_back(LogPosition{segment.path, segment.index.seek(from)});
+            }
+        }
+
+        active_->flush();
+        auto index = active_->index();
+        if (index.records > 0 && index.max_id >= from) {
+            positions.push_back(LogPosition{active_->path(), index.seek(from)});
+        }
+
+        return positions;
+    }
+
+    inline std::vector<LogPosition> SegmentedLog::chunks() const {
+        std::vector<LogPosition> pieces{};
+
+        std::shared_lock<std::shared_mutex> lock{mutex_};
+        for (auto &segment : sealed_) {
+            auto sealed = segment.index.chunks(segment.path);
+            pieces.insert(pieces.end(), sealed.begin(), sealed.end());
+        }
+
+        active_->flush();
+        auto active = active_->index().chunks(active_->path());
+        pieces.insert(pieces.end(), active.begin(), active.end());
+        return pieces;
+    }
+
+    inline std::size_t SegmentedLog::drop_before(EventID id) {
+        std::unique_lock<std::shared_mutex> lock{mutex_};
+
+        std::size_t dropped = 0;
+        while (dropped < sealed_.size() && sealed_[dropped].index.max_id < id) {
+            std::filesystem::remove(sealed_[dropped].path);
+            ++dropped;
+        }
+
+        sealed_.erase(sealed_.begin(), sealed_.begin() + dropped);
+        return dropped;
+    }
+
+
+    //Storage for EventLog and EventWriter over a SegmentedLog, which may be shared between writers
+    class SegmentedLogStorage final {
+    public:
+        using const_iterator = LogIterator;
+
+        explicit SegmentedLogStorage(std::shared_ptr<SegmentedLog> log) : log_{std::move(log)} {}
+
+        explicit SegmentedLogStorage(std::string directory, SegmentedLogOptions options = {}) :
+                log_{std::make_shared<SegmentedLog>(std::move(directory), options)} {}
+
+        void push_back(const Event &evt) {
+            log_->append(evt);
+        }
+
+        const_iterator begin() const {
+            return const_iterator{log_->positions(0)};
+        }
+
+        const_iterator end() const {
+            return const_iterator{};
+        }
+
+        std::vector<LogPosition> chunks() const {
+            return log_->chunks();
+        }
+
+        template<typename Visitor>
+        void replay_from(EventID from, Visitor &&visitor) const {
+            log_->replay_from(from, std::forward<Visitor>(visitor));
+        }
+
+        const std::shared_ptr<SegmentedLog> &log() const {
+            return log_;
+        }
+
+    private:
+        std::shared_ptr<SegmentedLog> log_;
+    };
+
+}
+
+#endif //EVENTVIEW_SEGMENTEDLOG_H
@@ -0,0 +1,152 @@
+
+#ifndef EVENTVIEW_SUBSCRIPTIONS_H
+#define EVENTVIEW_SUBSCRIPTIONS_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "types.h"
+#include "dependencies.h"
+#include "viewplan.h"
+#include "viewimpl.h"
+
+namespace eventview {
+
+    using SubscriptionID = std::uint64_t;
+
+    /*
+     * Standing views that are re-evaluated when a publish touches something they depend on. Dependencies are kept in
+     * a reverse index, so a publish only re-runs the subscriptions it affects. Everything except next_id runs on the
+     * dispatch worker, callbacks included: a callback must not block on the Publisher or ViewReader.
+     */
+    class SubscriptionRegistry final {
+    public:
+        explicit SubscriptionRegistry(std::shared_ptr<ViewReaderImpl> reader) : reader_{std::move(reader)},
+                                                                                next_id_{1} {}
+
+        SubscriptionRegistry(const SubscriptionRegistry &) = delete;
+
+        SubscriptionRegistry &operator=(const SubscriptionRegistry &) = delete;
+
+        ~SubscriptionRegistry() = default;
+
+        SubscriptionID next_id() {
+            return next_id_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /*
+         * evaluates the view once to learn its dependencies and delivers that initial state with EventID 0; a lookup
+         * that resolves to nothing registers nothing
+         */
+        inline void subscribe(SubscriptionID id, const ViewDescriptor &view_desc, ViewCallback callback);
+
+        inline void unsubscribe(SubscriptionID id);
+
+        void touched_node(const EntityDescriptor &node) {
+            collect(deps_.find_node(node));
+        }
+
+        void touched_reverse_field(const EntityDescriptor &node, const std::string &field) {
+            collect(deps_.find_reverse_field(node, field));
+        }
+
+        //for changes made to the store without publishing, such as a bulk load, that could affect any subscription
+        void touched_all() {
+            for (auto &entry : subscriptions_) {
+                pending_.insert(entry.first);
+            }
+        }
+
+        //re-evaluates every subscription touched since the last notify
+        inline void notify(EventID evt_id);
+
+        std::size_t size() const {
+            return subscriptions_.size();
+        }
+
+    private:
+        struct Subscription {
+            EntityDescriptor root;
+            std::shared_ptr<const ViewPlan> plan;
+            ViewCallback callback;
+            ReadDependencies deps;
+        };
+
+        void collect(const std::unordered_set<DependencyIndex::ID> *ids) {
+            if (ids) {
+                pending_.insert(ids->begin(), ids->end());
+            }
+        }
+
+        inline void evaluate(SubscriptionID id, Subscription &sub, EventID evt_id);
+
+        std::shared_ptr<ViewReaderImpl> reader_;
+        std::atomic<SubscriptionID> next_id_;
+        std::unordered_map<SubscriptionID, Subscription> subscriptions_;
+        DependencyIndex deps_;
+        std::unordered_set<SubscriptionID> pending_;
+    };
+
+    inline void SubscriptionRegistry::subscribe(SubscriptionID id, const ViewDescriptor &view_desc,
+                                                ViewCallback callback) {
+        auto plan = reader_->plan_for(view_desc);
+
+        //an index lookup is resolved once, so the subscription keeps following the entity it first found
+        auto root = reader_->resolve_root(view_desc);
+        if (!root) {
+            return;
+        }
+
+        auto &sub = subscriptions_[id];
+        sub = Subscription{*root, std::move(plan), std::move(callback), {}};
+
+        evaluate(id, sub, 0);
+    }
+
+    inline void SubscriptionRegistry::unsubscribe(SubscriptionID id) {
+        auto found = subscriptions_.find(id);
+        if (found != subscriptions_.end()) {
+            deps_.remove(id, found->second.deps);
+            subscriptions_.erase(found);
+        }
+        pending_.erase(id);
+    }
+
+    inline void SubscriptionRegistry::notify(EventID evt_id) {
+        if (pending_.empty()) {
+            return;
+        }
+
+        std::vector<SubscriptionID> affected{pending_.begin(), pending_.end()};
+        pending_.clear();
+
+        for (auto id : affected) {
+            auto found = subscriptions_.find(id);
+            if (found != subscriptions_.end()) {
+                evaluate(id, found->second, evt_id);
+            }
+        }
+    }
+
+    inline void SubscriptionRegistry::evaluate(SubscriptionID id, Subscription &sub, EventID evt_id) {
+        deps_.remove(id, sub.deps);
+        sub.deps = ReadDependencies{};
+
+        auto view = reader_->read_view(*sub.plan, sub.root, {}, &sub.deps);
+        deps_.add(id, sub.deps);
+
+        if (view) {
+            try {
+                sub.callback(evt_id, *view);
+            } catch (...) {
+                //a failing subscriber must not fail the publish that triggered it
+            }
+        }
+    }
+
+}
+
+#endif //EVENTVIEW_SUBSCRIPTIONS_H
@@ -3,6 +3,9 @@
 #include <functional>
 #include <variant>
 #include <atomic>
+#include <filesystem>
+#include <csignal>
+#include <sys/resource.h>
 
 #include "types.h"
 #include "snowflake.h"
@@ -15,6 +18,7 @@
 #include "mpsc.h"
 #include "opdispatch.h"
 #include "eventview.h"
+#include "viewplan.h"
 
 #define CATCH_CONFIG_MAIN
 
@@ -713,4 +717,2131 @@ TEST_CASE("write  and read api") {
     REQUIRE(employee_name_val);
     REQUIRE(employee_name_val->is_string());
     REQUIRE(employee_name_val->as_string() == "john");
-}
\ No newline at end of file
+}
+
+TEST_CASE("view plan") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(476, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    manager_entity.set_field("age", {56ull});
+    REQUIRE(writer.write_event(manager_entity));
+
+    std::vector<EntityDescriptor> employees{};
+    for (auto name : {"john", "jane"}) {
+        EntityDescriptor desc{writer.next_id(), 21};
+        Entity entity{desc};
+        entity.set_field("name", {std::string{name}});
+        entity.set_field("manager_id", {manager_desc});
+        REQUIRE(writer.write_event(entity));
+        employees.push_back(desc);
+    }
+
+    ViewPath vp_1{};
+    vp_1.push_back({"name", 0, false});
+
+    ViewPath vp_2{};
+    vp_2.push_back({"manager_id", 23, true});
+    vp_2.push_back({"name", 0, false});
+
+    auto plan = make_view_plan({vp_1, vp_2});
+    REQUIRE(plan->paths().size() == 2);
+    REQUIRE(plan->paths()[1].key == "manager_id.name");
+
+    const auto &john = reader.read_view(plan_descriptor(plan, employees[0]));
+    REQUIRE(john);
+    REQUIRE(john->get_path_val(vp_1)->as_string() == "john");
+    REQUIRE(john->get_path_val(vp_2)->as_string() == "ted");
+
+    const auto &jane = reader.read_view(plan_descriptor(plan, employees[1]));
+    REQUIRE(jane);
+    REQUIRE(jane->get_path_val(vp_1)->as_string() == "jane");
+    REQUIRE(jane->get_path_val(vp_2)->as_string() == "ted");
+
+    ViewPath dangling{};
+    dangling.push_back({"manager_id", 23, true});
+    REQUIRE_THROWS_AS(ViewPlan{{dangling}}, std::invalid_argument);
+    REQUIRE_THROWS_AS(ViewPlan{{ViewPath{}}}, std::invalid_argument);
+}
+
+TEST_CASE("view plan shared prefixes") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(477, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    REQUIRE(writer.write_event(manager_entity));
+
+    for (auto age : {31ull, 32ull, 33ull}) {
+        Entity entity{EntityDescriptor{writer.next_id(), 21}};
+        entity.set_field("name", {std::string{"report"}});
+        entity.set_field("age", {age});
+        entity.set_field("manager_id", {manager_desc});
+        REQUIRE(writer.write_event(entity));
+    }
+
+    ViewPath vp_1{};
+    vp_1.push_back({"manager_id", 21, false});
+    vp_1.push_back({"name", 0, false});
+
+    ViewPath vp_2{};
+    vp_2.push_back({"manager_id", 21, false});
+    vp_2.push_back({"age", 0, false});
+
+    ViewPath vp_3{};
+    vp_3.push_back({"name", 0, false});
+
+    ViewPlan plan{{vp_1, vp_2, vp_3}};
+
+    //one shared reverse hop, two values under it and one value at the root
+    REQUIRE(plan.nodes().size() == 4);
+    REQUIRE(plan.roots().size() == 2);
+    REQUIRE(plan.nodes()[plan.roots()[0]].children.size() == 2);
+
+    const auto &view = reader.read_view(ViewDescriptor{manager_desc, {vp_1, vp_2, vp_3}});
+    REQUIRE(view);
+    REQUIRE(view->get_path_vals(vp_1).size() == 3);
+
+    auto ages = view->get_path_vals(vp_2);
+    REQUIRE(ages.size() == 3);
+    std::uint64_t total = 0;
+    for (auto &age : ages) {
+        total += age.as_long();
+    }
+    REQUIRE(total == 96ull);
+
+    REQUIRE(view->get_path_val(vp_3)->as_string() == "ted");
+}
+
+TEST_CASE("view slots") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(478, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    REQUIRE(writer.write_event(manager_entity));
+
+    for (auto age : {41ull, 42ull}) {
+        Entity entity{EntityDescriptor{writer.next_id(), 21}};
+        entity.set_field("age", {age});
+        entity.set_field("manager_id", {manager_desc});
+        REQUIRE(writer.write_event(entity));
+    }
+
+    ViewPath vp_1{};
+    vp_1.push_back({"name", 0, false});
+
+    ViewPath vp_2{};
+    vp_2.push_back({"manager_id", 21, false});
+    vp_2.push_back({"age", 0, false});
+
+    ViewPath vp_3{};
+    vp_3.push_back({"missing", 0, false});
+
+    auto plan = make_view_plan({vp_1, vp_2, vp_3});
+
+    const auto &view = reader.read_view(plan_descriptor(plan, manager_desc));
+    REQUIRE(view);
+    REQUIRE(view->descriptor() == manager_desc);
+
+    auto name = view->value(plan->handle(0));
+    REQUIRE(name);
+    REQUIRE(name->as_string() == "ted");
+
+    auto ages = view->values(plan->handle(1));
+    REQUIRE(ages.size() == 2);
+    REQUIRE(ages[0].as_long() + ages[1].as_long() == 83ull);
+
+    REQUIRE(!view->value(plan->handle(2)));
+    REQUIRE(view->values(plan->handle(2)).empty());
+
+    auto handle = view->handle(vp_2);
+    REQUIRE(handle);
+    REQUIRE(handle->slot == plan->handle(1).slot);
+
+    const auto &adhoc = reader.read_view(ViewDescriptor{manager_desc, {vp_1, vp_2}});
+    REQUIRE(adhoc);
+    REQUIRE(adhoc->values(*adhoc->handle(vp_2)).size() == 2);
+}
+
+TEST_CASE("compile time path keys") {
+    using namespace eventview::path_literals;
+
+    static constexpr auto name_key = "name"_p;
+    static constexpr auto manager_name_key = "manager_id"_p / "name"_p;
+
+    static_assert(manager_name_key.hash() == fnv_append(FNV_OFFSET, "manager_id.name", 15), "hash is compile time");
+
+    auto view = build_view();
+
+    auto name = view.get_as<std::string>(name_key);
+    REQUIRE(name);
+    REQUIRE(*name == "ted");
+
+    REQUIRE(!view.get_as<std::uint64_t>(name_key));
+
+    auto age = view.get_as<std::uint64_t>("age"_p);
+    REQUIRE(age);
+    REQUIRE(*age == 67ull);
+
+    auto manager_name = view.get(manager_name_key);
+    REQUIRE(manager_name);
+    REQUIRE(manager_name->as_string() == "jack");
+
+    REQUIRE(view.get("manager_id.name"_p) == manager_name);
+    REQUIRE(view.get_all(manager_name_key).size() == 1);
+
+    REQUIRE(!view.get("manager_id"_p));
+    REQUIRE(!view.get("manager_id"_p / "age"_p));
+}
+
+TEST_CASE("batched read views") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(479, publisher);
+
+    ViewPath vp_1{};
+    vp_1.push_back({"name", 0, false});
+
+    auto plan = make_view_plan({vp_1});
+
+    std::vector<ViewDescriptor> descs{};
+    for (auto name : {"ann", "bob", "cal"}) {
+        Entity entity{EntityDescriptor{writer.next_id(), 21}};
+        entity.set_field("name", {std::string{name}});
+        REQUIRE(writer.write_event(entity));
+        descs.push_back(plan_descriptor(plan, entity.descriptor()));
+    }
+
+    //an unknown root only fails its own slot, and a malformed ad-hoc path only loses its own values
+    descs.push_back(plan_descriptor(plan, EntityDescriptor{1, 21}));
+    descs.push_back(ViewDescriptor{descs[0].root, {ViewPath{}}});
+    descs.push_back(ViewDescriptor{descs[1].root, {ViewPath{}, vp_1, {{"name", 0, false}, {"name", 0, false}}}});
+
+    auto views = reader.read_views(descs);
+    REQUIRE(views.size() == 6);
+
+    REQUIRE(views[0]);
+    REQUIRE(views[0]->get_path_val(vp_1)->as_string() == "ann");
+    REQUIRE(views[1]);
+    REQUIRE(views[1]->get_path_val(vp_1)->as_string() == "bob");
+    REQUIRE(views[2]);
+    REQUIRE(views[2]->get_path_val(vp_1)->as_string() == "cal");
+    REQUIRE(!views[3]);
+    REQUIRE(views[4]);
+    REQUIRE(!views[4]->get_path_val(vp_1));
+    REQUIRE(views[5]);
+    REQUIRE(views[5]->get_path_val(vp_1)->as_string() == "bob");
+}
+
+TEST_CASE("columnar read over many roots") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(480, publisher);
+
+    std::vector<EntityDescriptor> managers{};
+    for (std::uint64_t i = 0; i < 4; ++i) {
+        Entity manager{EntityDescriptor{writer.next_id(), 23}};
+        manager.set_field("name", {std::string{"manager"} + std::to_string(i)});
+        REQUIRE(writer.write_event(manager));
+        managers.push_back(manager.descriptor());
+
+        //manager i has i reports
+        for (std::uint64_t j = 0; j < i; ++j) {
+            Entity report{EntityDescriptor{writer.next_id(), 21}};
+            report.set_field("age", {20ull + j});
+            report.set_field("manager_id", {manager.descriptor()});
+            REQUIRE(writer.write_event(report));
+        }
+    }
+    managers.insert(managers.begin() + 2, EntityDescriptor{1, 23});
+
+    ViewPath vp_1{};
+    vp_1.push_back({"name", 0, false});
+
+    ViewPath vp_2{};
+    vp_2.push_back({"manager_id", 21, false});
+    vp_2.push_back({"age", 0, false});
+
+    auto plan = make_view_plan({vp_1, vp_2});
+
+    auto columns = reader.read_columns(plan, managers);
+    REQUIRE(columns);
+    REQUIRE(columns->rows() == 5);
+
+    REQUIRE(columns->found(0));
+    REQUIRE(!columns->found(2));
+    REQUIRE(columns->values(plan->handle(0), 2).empty());
+
+    REQUIRE(columns->values(plan->handle(0), 0)[0].as_string() == "manager0");
+    REQUIRE(columns->values(plan->handle(0), 4)[0].as_string() == "manager3");
+
+    std::vector<std::size_t> report_counts{};
+    for (std::size_t row = 0; row < columns->rows(); ++row) {
+        report_counts.push_back(columns->values(plan->handle(1), row).size());
+    }
+    REQUIRE(report_counts == std::vector<std::size_t>{0, 1, 0, 2, 3});
+
+    auto &ages = columns->column(*columns->handle(vp_2));
+    REQUIRE(ages.values.size() == 6);
+    REQUIRE(ages.offsets.size() == 6);
+
+    //a ref and a reverse ref by the same name share a slot, filled by separate passes over the rows
+    Entity peered{EntityDescriptor{writer.next_id(), 23}};
+    peered.set_field("name", {std::string{"peered"}});
+    peered.set_field("peer", {managers[0]});
+    REQUIRE(writer.write_event(peered));
+    Entity peering{EntityDescriptor{writer.next_id(), 23}};
+    peering.set_field("name", {std::string{"peering"}});
+    peering.set_field("peer", {managers[1]});
+    REQUIRE(writer.write_event(peering));
+    Entity follower{EntityDescriptor{writer.next_id(), 23}};
+    follower.set_field("name", {std::string{"follower"}});
+    follower.set_field("peer", {peered.descriptor()});
+    REQUIRE(writer.write_event(follower));
+
+    ViewPath peer_fwd{{"peer", 23, true}, {"name", 0, false}};
+    ViewPath peer_rev{{"peer", 23, false}, {"name", 0, false}};
+    auto peer_plan = make_view_plan({peer_fwd, peer_rev});
+    std::vector<EntityDescriptor> peer_roots{peered.descriptor(), peering.descriptor()};
+    auto peer_columns = reader.read_columns(peer_plan, peer_roots);
+    REQUIRE(peer_columns);
+    for (std::size_t row = 0; row < peer_roots.size(); ++row) {
+        auto view = reader.read_view(plan_descriptor(peer_plan, peer_roots[row]));
+        REQUIRE(view);
+        std::vector<std::string> expected{};
+        for (auto &value : view->get_path_vals(peer_fwd)) {
+            expected.push_back(value.as_string());
+        }
+        std::vector<std::string> actual{};
+        for (auto &value : peer_columns->values(peer_plan->handle(0), row)) {
+            actual.push_back(value.as_string());
+        }
+        REQUIRE(actual == expected);
+    }
+    REQUIRE(peer_columns->values(peer_plan->handle(0), 0).size() == 2);
+    REQUIRE(peer_columns->values(peer_plan->handle(0), 1)[0].as_string() == "manager1");
+}
+
+TEST_CASE("view cache") {
+    auto system =  make_eventview_system<5>(SystemOptions{64});
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(481, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+    EntityDescriptor other_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    REQUIRE(writer.write_event(manager_entity));
+
+    Entity other_entity{other_desc};
+    other_entity.set_field("name", {std::string{"ned"}});
+    REQUIRE(writer.write_event(other_entity));
+
+    Entity report{EntityDescriptor{writer.next_id(), 21}};
+    report.set_field("name", {std::string{"john"}});
+    report.set_field("manager_id", {manager_desc});
+    REQUIRE(writer.write_event(report));
+
+    ViewPath vp_1{};
+    vp_1.push_back({"name", 0, false});
+
+    ViewPath vp_2{};
+    vp_2.push_back({"manager_id", 21, false});
+    vp_2.push_back({"name", 0, false});
+
+    auto plan = make_view_plan({vp_1, vp_2});
+    auto desc = plan_descriptor(plan, manager_desc);
+
+    REQUIRE(reader.read_view(desc)->get_path_vals(vp_2).size() == 1);
+    REQUIRE(reader.read_view(desc)->get_path_vals(vp_2).size() == 1);
+
+    auto stats = reader.cache_stats();
+    REQUIRE(stats);
+    REQUIRE(stats->misses == 1);
+    REQUIRE(stats->hits == 1);
+    REQUIRE(stats->invalidations == 0);
+
+    //writes to unrelated entities leave the entry alone
+    other_entity.set_field("name", {std::string{"fred"}});
+    REQUIRE(writer.write_event(other_entity));
+    reader.read_view(desc);
+    REQUIRE(reader.cache_stats()->hits == 2);
+
+    //a new referencer changes the reverse-ref field the view fanned out over
+    Entity second_report{EntityDescriptor{writer.next_id(), 21}};
+    second_report.set_field("name", {std::string{"jane"}});
+    second_report.set_field("manager_id", {manager_desc});
+    REQUIRE(writer.write_event(second_report));
+
+    REQUIRE(reader.cache_stats()->invalidations == 1);
+    REQUIRE(reader.read_view(desc)->get_path_vals(vp_2).size() == 2);
+    REQUIRE(reader.cache_stats()->misses == 2);
+
+    //so does a change to a node reached through it
+    report.set_field("name", {std::string{"jon"}});
+    REQUIRE(writer.write_event(report));
+    REQUIRE(reader.cache_stats()->invalidations == 2);
+
+    auto names = reader.read_view(desc)->get_path_vals(vp_2);
+    REQUIRE(std::count(names.begin(), names.end(), PrimitiveFieldValue{std::string{"jon"}}) == 1);
+
+    //expectations are never served from the cache
+    auto expecting = desc;
+    expecting.expectation = ExpectedEntity{manager_desc, 1};
+    REQUIRE(reader.read_view(expecting));
+    REQUIRE(reader.cache_stats()->misses == 3);
+
+    auto uncached = make_eventview_system<5>();
+    REQUIRE(!uncached.second.cache_stats());
+
+    //a full cache drops the least recently used view, and hits share the cached view's values
+    auto store = std::make_shared<EntityStore>();
+    auto cache = std::make_shared<ViewCache>(2);
+    PublisherImpl direct_pub{store, cache};
+    ViewReaderImpl direct_reader{store, cache};
+    std::vector<ViewDescriptor> named{};
+    for (std::uint64_t id = 1; id <= 3; ++id) {
+        Entity entity{EntityDescriptor{id, 23}};
+        entity.set_field("name", {std::string{"n"} + std::to_string(id)});
+        Event evt{};
+        evt.id = 10 + id;
+        evt.entity = entity;
+        direct_pub.publish(std::move(evt));
+        named.push_back(ViewDescriptor{entity.descriptor(), {vp_1}});
+    }
+
+    direct_reader.read_view(named[0]);
+    direct_reader.read_view(named[1]);
+    auto again = direct_reader.read_view(named[0]);
+    REQUIRE(cache->stats().hits == 1);
+    auto handle = again->handle(vp_1);
+    REQUIRE(handle);
+    REQUIRE(again->values(*handle).begin() == direct_reader.read_view(named[0])->values(*handle).begin());
+    REQUIRE(again->get_path_val(vp_1)->as_string() == "n1");
+
+    //ad-hoc descriptors with the same paths are planned once
+    REQUIRE(direct_reader.plan_for(named[0]) == direct_reader.plan_for(named[2]));
+
+    direct_reader.read_view(named[2]);
+    REQUIRE(cache->size() == 2);
+    direct_reader.read_view(named[0]);
+    REQUIRE(cache->stats().hits == 3);
+    direct_reader.read_view(named[1]);
+    REQUIRE(cache->stats().misses == 4);
+}
+
+TEST_CASE("view subscriptions") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(482, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    REQUIRE(writer.write_event(manager_entity));
+
+    ViewPath vp_1{};
+    vp_1.push_back({"name", 0, false});
+
+    ViewPath vp_2{};
+    vp_2.push_back({"manager_id", 21, false});
+    vp_2.push_back({"name", 0, false});
+
+    std::vector<std::pair<EventID, std::size_t>> seen{};
+    auto id = reader.subscribe(ViewDescriptor{manager_desc, {vp_1, vp_2}}, [&](EventID evt_id, const View &view) {
+        seen.emplace_back(evt_id, view.get_path_vals(vp_2).size());
+    });
+    REQUIRE(id);
+
+    //subscribe completes on the worker, which delivers the initial state first
+    REQUIRE(seen.size() == 1);
+    REQUIRE(seen[0].first == 0);
+    REQUIRE(seen[0].second == 0);
+
+    Entity report{EntityDescriptor{writer.next_id(), 21}};
+    report.set_field("name", {std::string{"john"}});
+    report.set_field("manager_id", {manager_desc});
+    auto report_write = writer.write_event(report);
+    REQUIRE(report_write);
+
+    REQUIRE(seen.size() == 2);
+    REQUIRE(seen[1].first == report_write.event_id());
+    REQUIRE(seen[1].second == 1);
+
+    //unrelated writes do not re-run the subscription
+    Entity stranger{EntityDescriptor{writer.next_id(), 21}};
+    stranger.set_field("name", {std::string{"bob"}});
+    REQUIRE(writer.write_event(stranger));
+    REQUIRE(seen.size() == 2);
+
+    //a node reached through the view is a dependency too
+    report.set_field("name", {std::string{"jon"}});
+    REQUIRE(writer.write_event(report));
+    REQUIRE(seen.size() == 3);
+
+    reader.unsubscribe(*id);
+    manager_entity.set_field("name", {std::string{"fred"}});
+    REQUIRE(writer.write_event(manager_entity));
+    REQUIRE(seen.size() == 3);
+}
+
+TEST_CASE("read waits for expectation") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(483, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    auto first = writer.write_event(manager_entity);
+    REQUIRE(first);
+
+    ViewPath vp_1{};
+    vp_1.push_back({"name", 0, false});
+
+    //the expectation names a write that only lands while the read is parked
+    auto expected_write = writer.next_id() + (1ull << 22u) * 50;
+    ViewDescriptor view_desc{manager_desc, {vp_1}, ExpectedEntity{manager_desc, expected_write}};
+
+    auto waiting = std::async(std::launch::async, [&]() {
+        return reader.read_view(view_desc, std::chrono::milliseconds{5000});
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    manager_entity.set_field("name", {std::string{"fred"}});
+    REQUIRE(publisher.publish(Event{expected_write, manager_entity}));
+
+    auto view = waiting.get();
+    REQUIRE(view);
+    REQUIRE(view->get_path_val(vp_1)->as_string() == "fred");
+
+    //an expectation nothing satisfies comes back empty once the wait elapses
+    ViewDescriptor never{manager_desc, {vp_1}, ExpectedEntity{manager_desc, expected_write + 1}};
+    auto started = std::chrono::steady_clock::now();
+    REQUIRE(!reader.read_view(never, std::chrono::milliseconds{50}));
+    REQUIRE(std::chrono::steady_clock::now() - started >= std::chrono::milliseconds{50});
+}
+
+TEST_CASE("paged and streamed reverse refs") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(484, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    REQUIRE(writer.write_event(manager_entity));
+
+    for (std::uint64_t i = 0; i < 5; ++i) {
+        Entity report{EntityDescriptor{writer.next_id(), 21}};
+        report.set_field("age", {i});
+        report.set_field("manager_id", {manager_desc});
+        REQUIRE(writer.write_event(report));
+    }
+
+    PathElement reports{"manager_id", 21, false};
+    reports.limit = 2;
+
+    std::vector<std::uint64_t> ages{};
+    std::size_t pages = 0;
+    while (true) {
+        ViewPath vp{};
+        vp.push_back(reports);
+        vp.push_back({"age", 0, false});
+
+        const auto &view = reader.read_view(ViewDescriptor{manager_desc, {vp}});
+        REQUIRE(view);
+        ++pages;
+
+        auto handle = *view->handle(vp);
+        auto page = view->values(handle);
+        REQUIRE(page.size() <= 2);
+        for (auto &age : page) {
+            ages.push_back(age.as_long());
+        }
+
+        auto cursor = view->next_cursor(handle);
+        if (!cursor) {
+            break;
+        }
+        reports.after = *cursor;
+    }
+
+    REQUIRE(pages == 3);
+    //ids are snowflakes, so id order is write order
+    REQUIRE(ages == std::vector<std::uint64_t>{0, 1, 2, 3, 4});
+
+    ViewPath all{};
+    all.push_back({"manager_id", 21, false});
+    all.push_back({"age", 0, false});
+
+    std::vector<std::size_t> chunks{};
+    std::uint64_t total = 0;
+    REQUIRE(reader.stream_view(ViewDescriptor{manager_desc, {all}}, 2, [&](PathHandle, ValueSpan vals) {
+        chunks.push_back(vals.size());
+        for (auto &val : vals) {
+            total += val.as_long();
+        }
+    }));
+    REQUIRE(chunks == std::vector<std::size_t>{2, 2, 1});
+    REQUIRE(total == 10);
+
+    REQUIRE(!reader.stream_view(ViewDescriptor{EntityDescriptor{1, 23}, {all}}, 2, [](PathHandle, ValueSpan) {}));
+
+    ViewPath bad{};
+    PathElement paged_value{"age", 0, false};
+    paged_value.limit = 1;
+    bad.push_back(paged_value);
+    REQUIRE_THROWS_AS(ViewPlan{{bad}}, std::invalid_argument);
+}
+
+TEST_CASE("path predicates") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(485, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    REQUIRE(writer.write_event(manager_entity));
+
+    std::vector<std::string> names{"alice", "bob", "alfred", "carol", "alan"};
+    for (std::uint64_t i = 0; i < names.size(); ++i) {
+        Entity report{EntityDescriptor{writer.next_id(), 21}};
+        report.set_field("age", {i * 10});
+        report.set_field("name", {names[i]});
+        report.set_field("manager_id", {manager_desc});
+        REQUIRE(writer.write_event(report));
+    }
+
+    PathElement reports{"manager_id", 21, false};
+    reports.filters.push_back(FieldPredicate::range("age", {std::uint64_t{10}}, {std::uint64_t{30}}));
+
+    ViewPath in_range{};
+    in_range.push_back(reports);
+    in_range.push_back({"name", 0, false});
+
+    auto view = reader.read_view(ViewDescriptor{manager_desc, {in_range}});
+    REQUIRE(view);
+    auto names_in_range = view->values(*view->handle(in_range));
+    REQUIRE(names_in_range.size() == 3);
+    REQUIRE(names_in_range[0].as_string() == "bob");
+    REQUIRE(names_in_range[2].as_string() == "carol");
+
+    //the page limit counts matching referencers only
+    PathElement prefixed{"manager_id", 21, false};
+    prefixed.filters.push_back(FieldPredicate::prefix("name", "al"));
+    prefixed.limit = 2;
+
+    ViewPath al{};
+    al.push_back(prefixed);
+    al.push_back({"age", 0, false});
+
+    view = reader.read_view(ViewDescriptor{manager_desc, {al}});
+    REQUIRE(view);
+    auto handle = *view->handle(al);
+    REQUIRE(view->values(handle).size() == 2);
+    REQUIRE(view->values(handle)[1].as_long() == 20);
+    REQUIRE(view->next_cursor(handle));
+
+    PathElement ted_only{"name", 0, false};
+    ted_only.filters.push_back(FieldPredicate::equals("name", {std::string{"fred"}}));
+    ViewPath manager_name{};
+    manager_name.push_back(ted_only);
+
+    view = reader.read_view(ViewDescriptor{manager_desc, {manager_name}});
+    REQUIRE(view);
+    REQUIRE(view->values(*view->handle(manager_name)).empty());
+
+    //filtered paths with different predicates are different hops in the plan
+    auto plan = make_view_plan({in_range, al});
+    REQUIRE(plan->roots().size() == 2);
+
+    auto columns = reader.read_columns(plan, {manager_desc});
+    REQUIRE(columns);
+    REQUIRE(columns->values(plan->handle(0), 0).size() == 3);
+    REQUIRE(columns->values(plan->handle(1), 0).size() == 2);
+
+    //paths that differ only by filter keep their own results
+    PathElement young{"manager_id", 21, false};
+    young.filters.push_back(FieldPredicate::range("age", {std::uint64_t{0}}, {std::uint64_t{10}}));
+    PathElement old{"manager_id", 21, false};
+    old.filters.push_back(FieldPredicate::range("age", {std::uint64_t{30}}, {std::uint64_t{40}}));
+    ViewPath young_names{young, {"name", 0, false}};
+    ViewPath old_names{old, {"name", 0, false}};
+
+    auto by_age = make_view_plan({young_names, old_names});
+    view = reader.read_view(plan_descriptor(by_age, manager_desc));
+    REQUIRE(view);
+    REQUIRE(view->values(by_age->handle(0)).size() == 2);
+    REQUIRE(view->values(by_age->handle(0))[1].as_string() == "bob");
+    REQUIRE(view->values(by_age->handle(1)).size() == 2);
+    REQUIRE(view->values(by_age->handle(1))[0].as_string() == "carol");
+    REQUIRE(view->get_path_vals(old_names)[1].as_string() == "alan");
+
+    view = reader.read_view(ViewDescriptor{manager_desc, {young_names, old_names}});
+    REQUIRE(view);
+    REQUIRE(view->get_path_vals(young_names).size() == 2);
+    REQUIRE(view->get_path_vals(old_names)[0].as_string() == "carol");
+
+    ViewPath bad{};
+    PathElement bad_prefix{"manager_id", 21, false};
+    bad_prefix.filters.push_back(FieldPredicate{"name", FieldPredicate::Op::Prefix, {std::uint64_t{1}}, {}});
+    bad.push_back(bad_prefix);
+    bad.push_back({"name", 0, false});
+    REQUIRE_THROWS_AS(ViewPlan{{bad}}, std::invalid_argument);
+}
+
+TEST_CASE("aggregate paths") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(486, publisher);
+
+    EntityDescriptor manager_desc{writer.next_id(), 23};
+
+    Entity manager_entity{manager_desc};
+    manager_entity.set_field("name", {std::string{"ted"}});
+    REQUIRE(writer.write_event(manager_entity));
+
+    std::vector<EntityDescriptor> report_descs{};
+    for (std::uint64_t i = 1; i <= 4; ++i) {
+        EntityDescriptor report_desc{writer.next_id(), 21};
+        Entity report{report_desc};
+        report.set_field("age", {i * 10});
+        report.set_field("manager_id", {manager_desc});
+        REQUIRE(writer.write_event(report));
+        report_descs.push_back(report_desc);
+    }
+
+    auto aggregate_path = [](std::string field, Aggregate aggregate) {
+        PathElement terminal{std::move(field), 0, false};
+        terminal.aggregate = aggregate;
+        return ViewPath{{"manager_id", 21, false}, terminal};
+    };
+
+    auto count = aggregate_path("", Aggregate::Count);
+    auto sum = aggregate_path("age", Aggregate::Sum);
+    auto min = aggregate_path("age", Aggregate::Min);
+    auto max = aggregate_path("age", Aggregate::Max);
+    auto avg = aggregate_path("age", Aggregate::Avg);
+    ViewPath ages{{"manager_id", 21, false}, {"age", 0, false}};
+
+    auto plan = make_view_plan({count, sum, min, max, avg, ages});
+    auto view = reader.read_view(plan_descriptor(plan, manager_desc));
+    REQUIRE(view);
+    REQUIRE(view->values(plan->handle(0))[0].as_long() == 4);
+    REQUIRE(view->values(plan->handle(1))[0].as_long() == 100);
+    REQUIRE(view->values(plan->handle(2))[0].as_long() == 10);
+    REQUIRE(view->values(plan->handle(3))[0].as_long() == 40);
+    REQUIRE(view->values(plan->handle(4))[0].as_double() == 25.0);
+    //the aggregated paths do not collide with the plain one
+    REQUIRE(view->values(plan->handle(5)).size() == 4);
+
+    //nor do counts that differ only by a filter on the way
+    auto filtered_count = [](std::uint64_t lower, std::uint64_t upper) {
+        PathElement reports{"manager_id", 21, false};
+        reports.filters.push_back(FieldPredicate::range("age", {lower}, {upper}));
+        PathElement terminal{"age", 0, false};
+        terminal.aggregate = Aggregate::Count;
+        return ViewPath{reports, terminal};
+    };
+    auto counts = make_view_plan({filtered_count(10, 10), filtered_count(20, 40)});
+    auto counted = reader.read_view(plan_descriptor(counts, manager_desc));
+    REQUIRE(counted);
+    REQUIRE(counted->values(counts->handle(0))[0].as_long() == 1);
+    REQUIRE(counted->values(counts->handle(1))[0].as_long() == 3);
+
+    //the live degree follows removed references
+    Entity moved{report_descs[0]};
+    moved.set_field("age", {std::uint64_t{10}});
+    REQUIRE(writer.write_event(moved));
+
+    view = reader.read_view(plan_descriptor(plan, manager_desc));
+    REQUIRE(view);
+    REQUIRE(view->values(plan->handle(0))[0].as_long() == 3);
+    REQUIRE(view->values(plan->handle(1))[0].as_long() == 90);
+
+    auto columns = reader.read_columns(plan, {manager_desc, report_descs[0]});
+    REQUIRE(columns);
+    REQUIRE(columns->values(plan->handle(0), 0)[0].as_long() == 3);
+    REQUIRE(columns->values(plan->handle(4), 0)[0].as_double() == 30.0);
+    REQUIRE(columns->values(plan->handle(0), 1)[0].as_long() == 0);
+    REQUIRE(columns->values(plan->handle(1), 1).empty());
+
+    ViewPath bad{};
+    PathElement counted_ref{"manager_id", 21, false};
+    counted_ref.aggregate = Aggregate::Count;
+    bad.push_back(counted_ref);
+    bad.push_back({"age", 0, false});
+    REQUIRE_THROWS_AS(ViewPlan{{bad}}, std::invalid_argument);
+}
+
+TEST_CASE("ordered top k reverse refs") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(487, publisher);
+
+    EntityDescriptor post_desc{writer.next_id(), 23};
+
+    Entity post{post_desc};
+    post.set_field("title", {std::string{"hello"}});
+    REQUIRE(writer.write_event(post));
+
+    std::vector<std::uint64_t> likes{5, 50, 20, 40, 10};
+    std::vector<EntityDescriptor> comment_descs{};
+    for (std::uint64_t i = 0; i < likes.size(); ++i) {
+        EntityDescriptor comment_desc{writer.next_id(), 21};
+        Entity comment{comment_desc};
+        comment.set_field("seq", {i});
+        comment.set_field("likes", {likes[i]});
+        comment.set_field("post_id", {post_desc});
+        REQUIRE(writer.write_event(comment));
+        comment_descs.push_back(comment_desc);
+    }
+
+    auto read_seqs = [&](RefOrder order, std::string order_by, std::size_t limit) {
+        PathElement comments{"post_id", 21, false};
+        comments.order = order;
+        comments.order_by = std::move(order_by);
+        comments.limit = limit;
+        ViewPath vp{comments, {"seq", 0, false}};
+
+        auto view = reader.read_view(ViewDescriptor{post_desc, {vp}});
+        REQUIRE(view);
+        REQUIRE(!view->next_cursor(*view->handle(vp)));
+
+        std::vector<std::uint64_t> seqs{};
+        for (auto &val : view->values(*view->handle(vp))) {
+            seqs.push_back(val.as_long());
+        }
+        return seqs;
+    };
+
+    REQUIRE(read_seqs(RefOrder::Newest, "", 2) == std::vector<std::uint64_t>{4, 3});
+    REQUIRE(read_seqs(RefOrder::Oldest, "", 2) == std::vector<std::uint64_t>{0, 1});
+    REQUIRE(read_seqs(RefOrder::Highest, "likes", 3) == std::vector<std::uint64_t>{1, 3, 2});
+    REQUIRE(read_seqs(RefOrder::Lowest, "likes", 0) == std::vector<std::uint64_t>{0, 4, 2, 3, 1});
+
+    //rewriting an edge makes it the newest
+    Entity edited{comment_descs[0]};
+    edited.set_field("seq", {std::uint64_t{0}});
+    edited.set_field("likes", {std::uint64_t{100}});
+    edited.set_field("post_id", {post_desc});
+    REQUIRE(writer.write_event(edited));
+
+    REQUIRE(read_seqs(RefOrder::Newest, "", 2) == std::vector<std::uint64_t>{0, 4});
+    REQUIRE(read_seqs(RefOrder::Highest, "likes", 1) == std::vector<std::uint64_t>{0});
+
+    //and removing it drops it from the time order
+    Entity detached{comment_descs[0]};
+    detached.set_field("seq", {std::uint64_t{0}});
+    REQUIRE(writer.write_event(detached));
+
+    REQUIRE(read_seqs(RefOrder::Newest, "", 0) == std::vector<std::uint64_t>{4, 3, 2, 1});
+
+    ViewPath bad{};
+    PathElement unranked{"post_id", 21, false};
+    unranked.order = RefOrder::Highest;
+    bad.push_back(unranked);
+    bad.push_back({"seq", 0, false});
+    REQUIRE_THROWS_AS(ViewPlan{{bad}}, std::invalid_argument);
+}
+
+TEST_CASE("repeated path elements") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(488, publisher);
+
+    //ceo <- vp <- director <- manager <- engineer
+    std::vector<std::string> titles{"ceo", "vp", "director", "manager", "engineer"};
+    std::vector<EntityDescriptor> descs{};
+    for (auto &title : titles) {
+        EntityDescriptor desc{writer.next_id(), 21};
+        Entity person{desc};
+        person.set_field("title", {title});
+        if (!descs.empty()) {
+            person.set_field("boss_id", {descs.back()});
+        }
+        REQUIRE(writer.write_event(person));
+        descs.push_back(desc);
+    }
+
+    PathElement chain{"boss_id", 21, true};
+    chain.repeat = 3;
+    ViewPath up{chain, {"title", 0, false}};
+
+    auto view = reader.read_view(ViewDescriptor{descs[4], {up}});
+    REQUIRE(view);
+    auto bosses = view->values(*view->handle(up));
+    REQUIRE(bosses.size() == 3);
+    REQUIRE(bosses[0].as_string() == "manager");
+    REQUIRE(bosses[2].as_string() == "vp");
+
+    PathElement reports{"boss_id", 21, false};
+    reports.repeat = 10;
+    ViewPath down{reports, {"title", 0, false}};
+
+    view = reader.read_view(ViewDescriptor{descs[0], {down}});
+    REQUIRE(view);
+    REQUIRE(view->values(*view->handle(down)).size() == 4);
+
+    //closing the loop must not make the walk revisit anyone
+    Entity ceo{descs[0]};
+    ceo.set_field("title", {std::string{"ceo"}});
+    ceo.set_field("boss_id", {descs[4]});
+    REQUIRE(writer.write_event(ceo));
+
+    PathElement loop{"boss_id", 21, true};
+    loop.repeat = 100;
+    ViewPath around{loop, {"title", 0, false}};
+
+    view = reader.read_view(ViewDescriptor{descs[2], {around}});
+    REQUIRE(view);
+    auto everyone = view->values(*view->handle(around));
+    REQUIRE(everyone.size() == 4);
+    REQUIRE(everyone[3].as_string() == "manager");
+
+    auto plan = make_view_plan({down});
+    auto columns = reader.read_columns(plan, {descs[1], descs[3]});
+    REQUIRE(columns);
+    //with the loop closed every root reaches the four others exactly once
+    REQUIRE(columns->values(plan->handle(0), 0).size() == 4);
+    REQUIRE(columns->values(plan->handle(0), 1).size() == 4);
+
+    ViewPath bad{};
+    PathElement repeated_value{"title", 0, false};
+    repeated_value.repeat = 2;
+    bad.push_back(repeated_value);
+    REQUIRE_THROWS_AS(ViewPlan{{bad}}, std::invalid_argument);
+}
+
+TEST_CASE("lookup memo") {
+    EntityStore store{};
+    EntityDescriptor author_desc{1000, 21};
+    store.put(1, Entity{author_desc});
+
+    LookupMemo memo{};
+    for (int i = 0; i < 10; ++i) {
+        REQUIRE(memo.get(store, author_desc) == &store.get(author_desc)->get());
+    }
+    REQUIRE(memo.misses() == 1);
+    //a read that only ever resolves one descriptor allocates nothing
+    REQUIRE(memo.capacity() == 0);
+
+    //misses are remembered, and the type is part of the key
+    REQUIRE(!memo.get(store, EntityDescriptor{1000, 22}));
+    REQUIRE(!memo.get(store, EntityDescriptor{1000, 22}));
+    REQUIRE(!memo.get(store, EntityDescriptor{2000, 21}));
+    REQUIRE(memo.misses() == 3);
+    REQUIRE(memo.capacity() > 0);
+    REQUIRE(memo.get(store, author_desc) == &store.get(author_desc)->get());
+    REQUIRE(memo.misses() == 3);
+
+    //growing keeps every entry reachable
+    for (EntityID id = 3000; id < 3100; ++id) {
+        store.put(2, Entity{EntityDescriptor{id, 21}});
+    }
+    for (EntityID id = 3000; id < 3100; ++id) {
+        REQUIRE(memo.get(store, EntityDescriptor{id, 21}));
+    }
+    for (EntityID id = 3000; id < 3100; ++id) {
+        REQUIRE(memo.get(store, EntityDescriptor{id, 21})->descriptor().id == id);
+    }
+    REQUIRE(memo.misses() == 103);
+    REQUIRE(memo.get(store, author_desc));
+    REQUIRE(memo.misses() == 103);
+}
+
+TEST_CASE("coalesced identical reads") {
+    std::promise<void> started{};
+    std::promise<void> release{};
+    auto released = release.get_future().share();
+    std::atomic<int> calls{0};
+
+    EventPublishCallback pub = [](Event &&) {};
+    ViewReadCallback view = [&](const ViewDescriptor &) -> const std::optional<View> {
+        if (calls.fetch_add(1) == 0) {
+            started.set_value();
+            released.wait();
+        }
+        return build_view();
+    };
+
+    OpDispatch<5> dispatch{pub, view, {}, true};
+
+    ViewDescriptor hot{EntityDescriptor{234, 21}, {{{"name", 0, false}}}};
+    ViewDescriptor cold{EntityDescriptor{235, 21}, {{{"name", 0, false}}}};
+
+    auto first = dispatch.read_view(hot);
+    started.get_future().wait();
+
+    std::vector<std::future<std::optional<View>>> joined{};
+    for (int i = 0; i < 5; ++i) {
+        joined.push_back(dispatch.read_view(hot));
+    }
+    auto other = dispatch.read_view(cold);
+    release.set_value();
+
+    REQUIRE(first.get());
+    for (auto &f : joined) {
+        auto res = f.get();
+        REQUIRE(res);
+        REQUIRE(res->get_path_val<1>({"name"}) == build_view().get_path_val<1>({"name"}));
+    }
+    REQUIRE(other.get());
+
+    REQUIRE(calls.load() == 2);
+    REQUIRE(dispatch.coalesced_reads() == 5);
+
+    //once the shared read completed the next identical read runs on its own
+    REQUIRE(dispatch.read_view(hot).get());
+    REQUIRE(calls.load() == 3);
+}
+
+TEST_CASE("coalesced read dropped on a full queue") {
+    std::promise<void> started{};
+    std::promise<void> release{};
+    auto released = release.get_future().share();
+
+    EventPublishCallback pub = [](Event &&) {};
+    ViewReadCallback view = [&](const ViewDescriptor &view_desc) -> const std::optional<View> {
+        if (view_desc.root.id == 300) {
+            started.set_value();
+            released.wait();
+        }
+        return build_view();
+    };
+
+    //a ring of four holds three queued operations
+    OpDispatch<4> dispatch{pub, view, {}, true};
+
+    auto blocker = dispatch.read_view(ViewDescriptor{EntityDescriptor{300, 21}, {{{"name", 0, false}}}});
+    started.get_future().wait();
+
+    std::vector<std::future<std::optional<View>>> queued{};
+    for (std::uint64_t id = 301; id < 304; ++id) {
+        queued.push_back(dispatch.read_view(ViewDescriptor{EntityDescriptor{id, 21}, {{{"name", 0, false}}}}));
+    }
+
+    ViewDescriptor hot{EntityDescriptor{304, 21}, {{{"name", 0, false}}}};
+    auto dropped = dispatch.read_view(hot);
+    REQUIRE_THROWS(dropped.get());
+
+    release.set_value();
+    REQUIRE(blocker.get());
+    for (auto &f : queued) {
+        REQUIRE(f.get());
+    }
+
+    //the dropped read left nothing behind for the next identical read to join
+    auto retried = dispatch.read_view(hot);
+    REQUIRE(retried.wait_for(std::chrono::seconds(3)) == std::future_status::ready);
+    REQUIRE(retried.get());
+    REQUIRE(dispatch.coalesced_reads() == 0);
+}
+
+TEST_CASE("coalesced reads under contention") {
+    //readers hammering one hot view, each read costing the worker a fixed amount of time
+    auto contend = [](bool coalesce) {
+        std::atomic<int> calls{0};
+        EventPublishCallback pub = [](Event &&) {};
+        ViewReadCallback view = [&](const ViewDescriptor &) -> const std::optional<View> {
+            calls.fetch_add(1);
+            std::this_thread::sleep_for(std::chrono::microseconds{200});
+            return build_view();
+        };
+        OpDispatch<16> dispatch{pub, view, {}, coalesce};
+
+        ViewDescriptor hot{EntityDescriptor{234, 21}, {{{"name", 0, false}}}};
+        std::vector<std::thread> readers{};
+        std::atomic<int> answered{0};
+        for (int t = 0; t < 8; ++t) {
+            readers.emplace_back([&]() {
+                for (int i = 0; i < 50; ++i) {
+                    if (dispatch.read_view(hot).get()) {
+                        ++answered;
+                    }
+                }
+            });
+        }
+        for (auto &reader : readers) {
+            reader.join();
+        }
+
+        REQUIRE(answered == 400);
+        REQUIRE(static_cast<std::uint64_t>(calls.load()) + dispatch.coalesced_reads() == 400);
+        return calls.load();
+    };
+
+    REQUIRE(contend(false) == 400);
+    //the readers queue up behind one another, so most of them join a read that is still queued and the worker
+    //spends a fraction of the time evaluating
+    REQUIRE(contend(true) < 200);
+}
+
+TEST_CASE("secondary equality index") {
+    SystemOptions options{};
+    options.indexed_fields.push_back(IndexedField{21, "email"});
+    auto system =  make_eventview_system<5>(options);
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(489, publisher);
+
+    EntityDescriptor user_desc{writer.next_id(), 21};
+    auto stale_write = writer.next_id();
+
+    Entity user{user_desc};
+    user.set_field("name", {std::string{"jane"}});
+    user.set_field("email", {std::string{"jane@example.com"}});
+    REQUIRE(writer.write_event(user));
+
+    ViewPath name{{"name", 0, false}};
+    auto by_email = [&](std::string email) {
+        ViewDescriptor desc{};
+        desc.paths = {name};
+        desc.lookup = IndexLookup{21, "email", {std::move(email)}};
+        return reader.read_view(desc);
+    };
+
+    auto view = by_email("jane@example.com");
+    REQUIRE(view);
+    REQUIRE(view->get_path_val<1>({"name"})->as_string() == "jane");
+    REQUIRE(!by_email("nobody@example.com"));
+
+    user.set_field("email", {std::string{"jane@work.com"}});
+    REQUIRE(writer.write_event(user));
+
+    REQUIRE(!by_email("jane@example.com"));
+    REQUIRE(by_email("jane@work.com"));
+
+    //a late write that loses under LWW does not move the index back
+    Entity late{user_desc};
+    late.set_field("name", {std::string{"jane"}});
+    late.set_field("email", {std::string{"jane@example.com"}});
+    REQUIRE(publisher.publish(Event{stale_write, late}));
+
+    REQUIRE(!by_email("jane@example.com"));
+    REQUIRE(by_email("jane@work.com"));
+
+    //unindexed fields never resolve
+    ViewDescriptor unindexed{};
+    unindexed.paths = {name};
+    unindexed.lookup = IndexLookup{21, "name", {std::string{"jane"}}};
+    REQUIRE(!reader.read_view(unindexed));
+}
+
+TEST_CASE("ordered range index") {
+    SystemOptions options{};
+    options.indexed_fields.push_back(IndexedField{21, "price", IndexKind::Ordered});
+    auto system =  make_eventview_system<5>(options);
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(490, publisher);
+
+    std::vector<std::uint64_t> prices{30, 10, 50, 20, 40, 20};
+    std::vector<EntityDescriptor> descs{};
+    for (std::uint64_t i = 0; i < prices.size(); ++i) {
+        EntityDescriptor desc{writer.next_id(), 21};
+        Entity product{desc};
+        product.set_field("seq", {i});
+        product.set_field("price", {prices[i]});
+        REQUIRE(writer.write_event(product));
+        descs.push_back(desc);
+    }
+
+    ViewDescriptor between{};
+    between.paths = {{{"seq", 0, false}}};
+    between.range = RangeScan{21, "price", PrimitiveFieldValue{std::uint64_t{20}}, PrimitiveFieldValue{40.0}, 2};
+
+    std::vector<std::uint64_t> seqs{};
+    std::size_t pages = 0;
+    while (true) {
+        auto page = reader.scan_views(between);
+        REQUIRE(page);
+        ++pages;
+        for (auto &view : page->views) {
+            seqs.push_back(view.get_path_val<1>({"seq"})->as_long());
+        }
+        if (!page->next) {
+            break;
+        }
+        between.range->after = page->next;
+    }
+
+    REQUIRE(pages == 2);
+    //ordered by price, ties by id
+    REQUIRE(seqs == std::vector<std::uint64_t>{3, 5, 0, 4});
+
+    //read_view takes the first match of the range
+    ViewDescriptor cheapest{};
+    cheapest.paths = {{{"seq", 0, false}}};
+    cheapest.range = RangeScan{21, "price"};
+    auto view = reader.read_view(cheapest);
+    REQUIRE(view);
+    REQUIRE(view->get_path_val<1>({"seq"})->as_long() == 1);
+
+    //repricing moves the entity within the index
+    Entity repriced{descs[1]};
+    repriced.set_field("seq", {std::uint64_t{1}});
+    repriced.set_field("price", {std::uint64_t{60}});
+    REQUIRE(writer.write_event(repriced));
+
+    view = reader.read_view(cheapest);
+    REQUIRE(view);
+    REQUIRE(view->get_path_val<1>({"seq"})->as_long() == 3);
+
+    ViewDescriptor top{};
+    top.paths = {{{"seq", 0, false}}};
+    top.range = RangeScan{21, "price", PrimitiveFieldValue{std::uint64_t{55}}};
+    auto page = reader.scan_views(top);
+    REQUIRE(page);
+    REQUIRE(page->views.size() == 1);
+    REQUIRE(page->views[0].get_path_val<1>({"seq"})->as_long() == 1);
+
+    //ordered indexes answer equality lookups too
+    ViewDescriptor exact{};
+    exact.paths = {{{"seq", 0, false}}};
+    exact.lookup = IndexLookup{21, "price", {std::uint64_t{50}}};
+    view = reader.read_view(exact);
+    REQUIRE(view);
+    REQUIRE(view->get_path_val<1>({"seq"})->as_long() == 2);
+
+    //longs and doubles compare exactly, even past the 53 bits a double holds, and NaN sorts after every number
+    PrimitiveFieldValueOrder less{};
+    PrimitiveFieldValue two_53{9007199254740992.0};
+    PrimitiveFieldValue two_53_plus_one{std::uint64_t{9007199254740993ull}};
+    REQUIRE(less(two_53, two_53_plus_one));
+    REQUIRE(!less(two_53_plus_one, two_53));
+    REQUIRE(!less(PrimitiveFieldValue{std::uint64_t{9007199254740992ull}}, two_53));
+    REQUIRE(!less(two_53, PrimitiveFieldValue{std::uint64_t{9007199254740992ull}}));
+    REQUIRE(less(PrimitiveFieldValue{std::uint64_t{UINT64_MAX}}, PrimitiveFieldValue{18446744073709551616.0}));
+    REQUIRE(less(PrimitiveFieldValue{-0.5}, PrimitiveFieldValue{std::uint64_t{0}}));
+    REQUIRE(less(PrimitiveFieldValue{std::uint64_t{2}}, PrimitiveFieldValue{2.5}));
+    REQUIRE(!less(PrimitiveFieldValue{2.5}, PrimitiveFieldValue{std::uint64_t{2}}));
+
+    PrimitiveFieldValue nan{std::nan("")};
+    REQUIRE(less(PrimitiveFieldValue{std::uint64_t{UINT64_MAX}}, nan));
+    REQUIRE(less(PrimitiveFieldValue{HUGE_VAL}, nan));
+    REQUIRE(!less(nan, PrimitiveFieldValue{HUGE_VAL}));
+    REQUIRE(!less(nan, nan));
+    REQUIRE(less(nan, PrimitiveFieldValue{std::string{"a"}}));
+
+    Entity unpriced{EntityDescriptor{writer.next_id(), 21}};
+    unpriced.set_field("seq", {std::uint64_t{6}});
+    unpriced.set_field("price", {std::nan("")});
+    REQUIRE(writer.write_event(unpriced));
+    Entity exact_price{EntityDescriptor{writer.next_id(), 21}};
+    exact_price.set_field("seq", {std::uint64_t{7}});
+    exact_price.set_field("price", {std::uint64_t{9007199254740993ull}});
+    REQUIRE(writer.write_event(exact_price));
+
+    ViewDescriptor priciest{};
+    priciest.paths = {{{"seq", 0, false}}};
+    priciest.range = RangeScan{21, "price", PrimitiveFieldValue{std::uint64_t{55}}};
+    page = reader.scan_views(priciest);
+    REQUIRE(page);
+    std::vector<std::uint64_t> by_price{};
+    for (auto &priced : page->views) {
+        by_price.push_back(priced.get_path_val<1>({"seq"})->as_long());
+    }
+    REQUIRE(by_price == std::vector<std::uint64_t>{1, 7, 6});
+
+    //a double bound just below the long excludes it, and no finite upper bound reaches NaN
+    priciest.range = RangeScan{21, "price", PrimitiveFieldValue{std::uint64_t{55}}, two_53};
+    page = reader.scan_views(priciest);
+    REQUIRE(page);
+    REQUIRE(page->views.size() == 1);
+    REQUIRE(page->views[0].get_path_val<1>({"seq"})->as_long() == 1);
+}
+
+TEST_CASE("prefix scans") {
+    SystemOptions options{};
+    options.indexed_fields.push_back(IndexedField{21, "name", IndexKind::Ordered});
+    auto system =  make_eventview_system<5>(options);
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(491, publisher);
+
+    std::vector<std::string> names{"alfred", "bob", "alice", "al", "alan", "bert", "aaron"};
+    for (auto &name : names) {
+        Entity person{EntityDescriptor{writer.next_id(), 21}};
+        person.set_field("name", {name});
+        REQUIRE(writer.write_event(person));
+    }
+
+    Entity numbered{EntityDescriptor{writer.next_id(), 21}};
+    numbered.set_field("name", {std::uint64_t{7}});
+    REQUIRE(writer.write_event(numbered));
+
+    auto typeahead = [&](std::string prefix, std::size_t limit) {
+        ViewDescriptor desc{};
+        desc.paths = {{{"name", 0, false}}};
+        desc.range = RangeScan::starting_with(21, "name", std::move(prefix), limit);
+
+        std::vector<std::string> hits{};
+        auto page = reader.scan_views(desc);
+        REQUIRE(page);
+        for (auto &view : page->views) {
+            hits.push_back(view.get_path_val<1>({"name"})->as_string());
+        }
+        return hits;
+    };
+
+    REQUIRE(typeahead("al", 10) == std::vector<std::string>{"al", "alan", "alfred", "alice"});
+    REQUIRE(typeahead("al", 2) == std::vector<std::string>{"al", "alan"});
+    REQUIRE(typeahead("b", 10) == std::vector<std::string>{"bert", "bob"});
+    REQUIRE(typeahead("c", 10).empty());
+    REQUIRE(typeahead("", 3) == std::vector<std::string>{"aaron", "al", "alan"});
+
+    //a lower bound inside the prefix starts the scan there, one below it changes nothing
+    auto from = [&](std::string prefix, std::string lower) {
+        ViewDescriptor desc{};
+        desc.paths = {{{"name", 0, false}}};
+        desc.range = RangeScan::starting_with(21, "name", std::move(prefix), 10);
+        desc.range->lower = PrimitiveFieldValue{std::move(lower)};
+
+        std::vector<std::string> hits{};
+        auto page = reader.scan_views(desc);
+        REQUIRE(page);
+        for (auto &view : page->views) {
+            hits.push_back(view.get_path_val<1>({"name"})->as_string());
+        }
+        return hits;
+    };
+    REQUIRE(from("al", "alb") == std::vector<std::string>{"alfred", "alice"});
+    REQUIRE(from("al", "a") == std::vector<std::string>{"al", "alan", "alfred", "alice"});
+}
+
+TEST_CASE("parallel type scan") {
+    auto system =  make_eventview_system<5>();
+    auto& publisher = system.first;
+    auto& reader = system.second;
+    auto writer = make_writer<5>(492, publisher);
+
+    EntityDescriptor team_desc{writer.next_id(), 23};
+    Entity team{team_desc};
+    team.set_field("name", {std::string{"core"}});
+    REQUIRE(writer.write_event(team));
+
+    std::uint64_t expected = 0;
+    for (std::uint64_t i = 0; i < 50; ++i) {
+        Entity member{EntityDescriptor{writer.next_id(), 21}};
+        member.set_field("seq", {i});
+        member.set_field("team_id", {team_desc});
+        REQUIRE(writer.write_event(member));
+        expected += i;
+    }
+
+    auto plan = make_view_plan({{{"seq", 0, false}}, {{"team_id", 23, true}, {"name", 0, false}}});
+
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::size_t> on_team{0};
+    auto visited = reader.scan_type(21, plan, [&](const View &view) {
+        total += view.values(plan->handle(0))[0].as_long();
+        if (view.values(plan->handle(1))[0].as_string() == "core") {
+            ++on_team;
+        }
+    }, 3, 7);
+
+    REQUIRE(visited);
+    REQUIRE(*visited == 50);
+    REQUIRE(total == expected);
+    REQUIRE(on_team == 50);
+
+    REQUIRE(*reader.scan_type(23, plan, [](const View &) {}) == 1);
+    REQUIRE(*reader.scan_type(99, plan, [](const View &) {}) == 0);
+
+    //the visitor runs off the worker, so it may publish and wait for the write without stalling the scan
+    std::atomic<std::size_t> published{0};
+    auto publishing = reader.scan_type(21, plan, [&](const View &view) {
+        auto seq = view.values(plan->handle(0))[0].as_long();
+        if (seq % 10 == 0) {
+            Entity note{EntityDescriptor{5000 + seq, 24}};
+            note.set_field("seq", {seq});
+            Event evt{};
+            evt.id = writer.next_id();
+            evt.entity = std::move(note);
+            if (publisher.publish(std::move(evt))) {
+                ++published;
+            }
+        }
+    }, 2, 8);
+    REQUIRE(publishing);
+    REQUIRE(*publishing == 50);
+    REQUIRE(published == 5);
+    REQUIRE(*reader.scan_type(24, plan, [](const View &) {}) == 5);
+
+    //a throwing visitor fails the scan rather than the worker
+    REQUIRE(!reader.scan_type(21, plan, [](const View &) { throw std::runtime_error{"boom"}; }, 2, 10));
+    REQUIRE(reader.read_view(ViewDescriptor{team_desc, {{{"name", 0, false}}}}));
+}
+
+TEST_CASE("file log storage") {
+    std::string path{"/tmp/eventview_file_log_test.log"};
+    std::remove(path.c_str());
+
+    auto file = std::make_shared<LogFile>(path, LogFileOptions{Durability::GroupCommit,
+                                                                std::chrono::microseconds{500}});
+
+    std::vector<std::thread> writers{};
+    for (std::uint32_t w = 0; w < 4; ++w) {
+        writers.emplace_back([&, w]() {
+            auto writer = make_writer(500 + w, NoOpReceiver, FileLogStorage{file});
+            for (std::uint64_t i = 0; i < 25; ++i) {
+                Entity entity{EntityDescriptor{writer.next_id(), 30 + w}};
+                entity.set_field("seq", {i});
+                entity.set_field("name", {std::string{"writer"} + std::to_string(w)});
+                entity.set_field("ratio", {0.5});
+                entity.set_field("live", {true});
+                entity.set_field("owner", {EntityDescriptor{7, 8}});
+                REQUIRE(writer.write_event(entity));
+            }
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+
+    //a reopened log replays everything any writer appended
+    std::vector<Event> replayed{};
+    EventLog<FileLogStorage> log{[&](Event &&evt) { replayed.push_back(std::move(evt)); }, FileLogStorage{path}};
+    log.replay();
+
+    REQUIRE(replayed.size() == 100);
+    std::vector<std::uint64_t> per_writer(4, 0);
+    for (auto &evt : replayed) {
+        auto &fields = evt.entity.fields();
+        auto w = evt.entity.descriptor().type - 30;
+        REQUIRE(evt.id != 0);
+        REQUIRE(fields.at("seq").as_long() == per_writer[w]++);
+        REQUIRE(fields.at("name").as_string() == std::string{"writer"} + std::to_string(w));
+        REQUIRE(fields.at("ratio").as_double() == 0.5);
+        REQUIRE(std::get<bool>(fields.at("live").val));
+        REQUIRE(fields.at("owner").as_descriptor() == EntityDescriptor{7, 8});
+    }
+
+    //a torn tail from a crash mid-append is dropped on replay
+    {
+        std::ofstream out{path, std::ios::binary | std::ios::app};
+        out.write("\x40\x00\x00\x00\x01", 5);
+    }
+    std::size_t count = 0;
+    for (auto i = FileLogStorage{path}.begin(); i != FileLogStorage::const_iterator{}; ++i) {
+        ++count;
+    }
+    REQUIRE(count == 100);
+    file.reset();
+
+    for (auto durability : {Durability::EveryWrite, Durability::OsBuffered}) {
+        std::remove(path.c_str());
+        {
+            auto writer = make_writer(510, NoOpReceiver, FileLogStorage{path, LogFileOptions{durability}});
+            for (std::uint64_t i = 0; i < 10; ++i) {
+                Entity entity{EntityDescriptor{writer.next_id(), 31}};
+                entity.set_field("seq", {i});
+                REQUIRE(writer.write_event(entity));
+            }
+        }
+
+        std::uint64_t seq = 0;
+        for (auto &evt : FileLogStorage{path}) {
+            REQUIRE(evt.entity.fields().at("seq").as_long() == seq++);
+        }
+        REQUIRE(seq == 10);
+    }
+
+    //buffers written out by racing appends still reach the file in the order they were encoded
+    std::remove(path.c_str());
+    std::vector<std::vector<EventID>> appended(8);
+    {
+        LogFile buffered{path, LogFileOptions{Durability::OsBuffered, {}, 1}};
+        std::vector<std::thread> appenders{};
+        for (std::uint32_t w = 0; w < 8; ++w) {
+            appenders.emplace_back([&, w]() {
+                SnowflakeProvider<> ids{512 + w};
+                for (std::uint64_t i = 0; i < 1000; ++i) {
+                    Event evt{};
+                    evt.id = ids.next();
+                    evt.entity = Entity{EntityDescriptor{evt.id, 32}};
+                    evt.entity.set_field("field" + std::to_string(i % 50), {i});
+                    buffered.append(evt);
+                    appended[w].push_back(evt.id);
+                }
+            });
+        }
+        for (auto &appender : appenders) {
+            appender.join();
+        }
+    }
+
+    std::vector<EventID> expected_ids{};
+    for (auto &ids : appended) {
+        expected_ids.insert(expected_ids.end(), ids.begin(), ids.end());
+    }
+    std::vector<EventID> read_ids{};
+    for (auto &evt : FileLogStorage{path}) {
+        read_ids.push_back(evt.id);
+    }
+    std::sort(expected_ids.begin(), expected_ids.end());
+    std::sort(read_ids.begin(), read_ids.end());
+    REQUIRE(read_ids == expected_ids);
+
+    //a write that fails part way is cut back off and fails the file, leaving every acknowledged event readable
+    auto limited_event = [](std::uint64_t seq) {
+        Event evt{};
+        evt.id = 1000 + seq;
+        evt.entity = Entity{EntityDescriptor{evt.id, 33}};
+        evt.entity.set_field("seq", {seq});
+        evt.entity.set_field("payload", {std::string(60, 'x')});
+        return evt;
+    };
+    for (auto durability : {Durability::EveryWrite, Durability::GroupCommit, Durability::OsBuffered}) {
+        std::remove(path.c_str());
+        rlimit original{};
+        getrlimit(RLIMIT_FSIZE, &original);
+        auto handler = std::signal(SIGXFSZ, SIG_IGN);
+
+        std::uint64_t acknowledged = 0;
+        {
+            LogFile limited{path, LogFileOptions{durability}};
+            rlimit small{original};
+            small.rlim_cur = 4000;
+            setrlimit(RLIMIT_FSIZE, &small);
+            for (; acknowledged < 1000; ++acknowledged) {
+                try {
+                    limited.append(limited_event(acknowledged));
+                } catch (std::exception &) {
+                    break;
+                }
+            }
+            REQUIRE(limited.failed());
+            REQUIRE_THROWS(limited.append(limited_event(acknowledged)));
+            REQUIRE(limited.index().records == acknowledged);
+            REQUIRE(limited.index().bytes <= 4000);
+        }
+        setrlimit(RLIMIT_FSIZE, &original);
+        std::signal(SIGXFSZ, handler);
+        REQUIRE(acknowledged > 0);
+
+        //the reopened file continues its encoding stream after the last whole record
+        {
+            LogFile reopened{path, LogFileOptions{Durability::EveryWrite}};
+            reopened.append(limited_event(acknowledged));
+        }
+        std::uint64_t seq = 0;
+        for (auto &evt : FileLogStorage{path}) {
+            REQUIRE(evt.entity.fields().at("seq").as_long() == seq++);
+        }
+        REQUIRE(seq == acknowledged + 1);
+    }
+    std::remove(path.c_str());
+}
+
+TEST_CASE("event codec") {
+    SnowflakeProvider<> snowflakes{520};
+
+    std::vector<Event> events{};
+    for (std::uint64_t i = 0; i < 20; ++i) {
+        Event evt{};
+        evt.id = snowflakes.next();
+        evt.entity = Entity{evt.id, 40};
+        evt.entity.set_field("seq", {i});
+        evt.entity.set_field("title", {std::string{"title "} + std::to_string(i)});
+        evt.entity.set_field("score", {i * 0.25});
+        evt.entity.set_field("open", {i % 2 == 0});
+        evt.entity.set_field("parent", {EntityDescriptor{events.empty() ? 1 : events.back().id, 40}});
+        events.push_back(evt);
+    }
+    //ids interleaved from another writer go backwards as well as forwards
+    std::swap(events[3], events[4]);
+
+    auto batch = encode_events(events);
+    REQUIRE(decode_events(batch) == events);
+
+    //names after their first use and nearby ids cost a few bytes each
+    std::size_t names = 0;
+    for (auto &kv : events[0].entity.fields()) {
+        names += kv.first.size();
+    }
+    REQUIRE(batch.size() < events.size() * (names + 5 * 8 + 16));
+
+    EventEncoder encoder{};
+    auto first = encoder.encode(events[0]);
+    auto second = encoder.encode(events[1]);
+    REQUIRE(second.size() + names <= first.size() + 4);
+
+    //fields read in place without building the entity
+    EventDecoder decoder{};
+    const char *pos = first.data();
+    auto encoded = decoder.next(pos, first.data() + first.size());
+    REQUIRE(pos == first.data() + first.size());
+    REQUIRE(encoded.id() == events[0].id);
+    REQUIRE(encoded.descriptor() == events[0].entity.descriptor());
+    REQUIRE(encoded.field_count() == 5);
+    REQUIRE(encoded.find("title")->as_string() == "title 0");
+    REQUIRE(encoded.find("parent")->as_descriptor() == EntityDescriptor{1, 40});
+    REQUIRE(encoded.find("open")->as_bool());
+    REQUIRE(!encoded.find("missing"));
+
+    pos = second.data();
+    encoded = decoder.next(pos, second.data() + second.size());
+    REQUIRE(encoded.find("seq")->as_long() == 1);
+    REQUIRE(encoded.find("score")->as_double() == 0.25);
+    REQUIRE(encoded.to_event() == events[1]);
+
+    pos = batch.data();
+    REQUIRE_THROWS(decoder.next(pos, batch.data() + 3));
+
+    //a record that fails part way leaves the decoder where the last good record did
+    std::string corrupt{};
+    codec::put_varint(corrupt, codec::delta(events[2].id, decoder.last_id()));
+    codec::put_varint(corrupt, codec::delta(events[2].id, events[2].id));
+    codec::put_varint(corrupt, 40);
+    codec::put_varint(corrupt, 2);
+    codec::put_varint(corrupt, 0);
+    codec::put_varint(corrupt, 5);
+    corrupt.append("fresh");
+    corrupt.push_back(static_cast<char>(codec::FieldTag::True));
+    codec::put_varint(corrupt, 0);
+    codec::put_varint(corrupt, 4);
+    corrupt.append("torn");
+    corrupt.push_back(static_cast<char>(99));
+
+    auto known = decoder.dictionary().size();
+    auto last = decoder.last_id();
+    pos = corrupt.data();
+    REQUIRE_THROWS(decoder.next(pos, corrupt.data() + corrupt.size()));
+    REQUIRE(decoder.dictionary().size() == known);
+    REQUIRE(!decoder.dictionary().find("fresh"));
+    REQUIRE(decoder.last_id() == last);
+
+    //a reopened file log continues its encoding stream
+    std::string path{"/tmp/eventview_codec_test.log"};
+    std::remove(path.c_str());
+    {
+        FileLogStorage storage{path, LogFileOptions{Durability::OsBuffered}};
+        for (std::size_t i = 0; i < 10; ++i) {
+            storage.push_back(events[i]);
+        }
+    }
+    {
+        FileLogStorage storage{path, LogFileOptions{Durability::EveryWrite}};
+        for (std::size_t i = 10; i < events.size(); ++i) {
+            storage.push_back(events[i]);
+        }
+    }
+
+    std::vector<Event> replayed{};
+    for (auto &evt : FileLogStorage{path}) {
+        replayed.push_back(evt);
+    }
+    REQUIRE(replayed == events);
+
+    //a torn header claiming a huge record is cut off without reading or allocating that much
+    {
+        std::ofstream out{path, std::ios::binary | std::ios::app};
+        out.write("\xf0\xff\xff\x7f\x00\x00\x00\x00\x01\x02", 10);
+    }
+    {
+        FileLogStorage storage{path, LogFileOptions{Durability::EveryWrite}};
+        storage.push_back(events[0]);
+    }
+    replayed.clear();
+    for (auto &evt : FileLogStorage{path}) {
+        replayed.push_back(evt);
+    }
+    REQUIRE(replayed.size() == events.size() + 1);
+    REQUIRE(replayed.back() == events[0]);
+    std::remove(path.c_str());
+}
+
+TEST_CASE("segmented log") {
+    std::string dir{"/tmp/eventview_segmented_log_test"};
+    std::filesystem::remove_all(dir);
+
+    SegmentedLogOptions options{};
+    options.file = LogFileOptions{Durability::OsBuffered};
+    options.file.restart_bytes = 256;
+    options.segment_bytes = 1024;
+
+    std::vector<Event> events{};
+    {
+        auto writer = make_writer(530, NoOpReceiver, SegmentedLogStorage{dir, options});
+        for (std::uint64_t i = 0; i < 200; ++i) {
+            Entity entity{EntityDescriptor{writer.next_id(), 50}};
+            entity.set_field("seq", {i});
+            entity.set_field("label", {std::string{"event "} + std::to_string(i)});
+            auto result = writer.write_event(entity);
+            REQUIRE(result);
+
+            Event evt{};
+            evt.id = result.event_id();
+            evt.entity = entity;
+            events.push_back(evt);
+        }
+    }
+
+    //a reopened log finds its segments and reads across all of them, ignoring other .log files
+    std::ofstream{dir + "/notes.log"} << "not a segment";
+    auto log = std::make_shared<SegmentedLog>(dir, options);
+    auto segments = log->segment_count();
+    REQUIRE(segments > 3);
+
+    SegmentedLogOptions unbounded{options};
+    unbounded.segment_bytes = 0;
+    REQUIRE_THROWS_AS(SegmentedLog(dir, unbounded), std::invalid_argument);
+
+    std::vector<Event> replayed{};
+    for (auto &evt : SegmentedLogStorage{log}) {
+        replayed.push_back(evt);
+    }
+    REQUIRE(replayed == events);
+
+    //replay from an id seeks past earlier segments and restart points
+    auto from = events[150].id;
+    auto positions = log->positions(from);
+    REQUIRE(positions.size() < segments);
+
+    replayed.clear();
+    EventLog<SegmentedLogStorage> event_log{[&](Event &&evt) { replayed.push_back(std::move(evt)); },
+                                            SegmentedLogStorage{log}};
+    event_log.replay_from(from);
+    REQUIRE(replayed == std::vector<Event>(events.begin() + 150, events.end()));
+
+    //ids appended out of order across writers are still found
+    Event late{};
+    late.id = events[10].id + 1;
+    late.entity = Entity{EntityDescriptor{late.id, 50}};
+    log->append(late);
+    replayed.clear();
+    log->replay_from(events[199].id, [&](Event &&evt) { replayed.push_back(std::move(evt)); });
+    REQUIRE(replayed.size() == 1);
+    replayed.clear();
+    log->replay_from(events[10].id + 1, [&](Event &&evt) { replayed.push_back(std::move(evt)); });
+    REQUIRE(replayed.size() == 190);
+
+    //old history goes a whole segment at a time
+    auto dropped = log->drop_before(from);
+    REQUIRE(dropped > 0);
+    REQUIRE(log->segment_count() == segments - dropped);
+    replayed.clear();
+    log->replay_from(0, [&](Event &&evt) { replayed.push_back(std::move(evt)); });
+    REQUIRE(replayed.size() < 201);
+    REQUIRE(replayed.size() >= 51);
+    REQUIRE(std::find(replayed.begin(), replayed.end(), events[150]) != replayed.end());
+
+    //within a file, replay starts at the last restart point before the id
+    std::string path{"/tmp/eventview_single_segment_test.log"};
+    std::remove(path.c_str());
+    FileLogStorage single{path, LogFileOptions{Durability::OsBuffered, {}, 1u << 20u, 64}};
+    for (auto &evt : events) {
+        single.push_back(evt);
+    }
+    auto index = single.file()->index();
+    REQUIRE(index.records == 200);
+    REQUIRE(index.restarts.size() > 10);
+    REQUIRE(index.seek(events[0].id) == 0);
+    REQUIRE(index.seek(events[199].id) > index.seek(events[100].id));
+    REQUIRE(index.seek(events[199].id) < index.bytes);
+    replayed.clear();
+    single.replay_from(events[199].id, [&](Event &&evt) { replayed.push_back(std::move(evt)); });
+    REQUIRE(replayed == std::vector<Event>{events[199]});
+    std::remove(path.c_str());
+
+    //segments can also be bounded by the time their events span
+    std::filesystem::remove_all(dir);
+    options.segment_span = std::chrono::milliseconds{1};
+    SegmentedLog timed{dir, options};
+    SnowflakeIDPacker packer{};
+    for (std::uint64_t ms = 0; ms < 4; ++ms) {
+        Event evt{};
+        evt.id = packer.pack(1000 + ms, 3, 0);
+        evt.entity = Entity{EntityDescriptor{evt.id, 50}};
+        timed.append(evt);
+    }
+    REQUIRE(timed.segment_count() == 4);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("bulk replay") {
+    std::string path{"/tmp/eventview_bulk_replay_test.log"};
+    std::remove(path.c_str());
+
+    std::vector<EntityDescriptor> teams{};
+    std::vector<EntityDescriptor> members{};
+    {
+        FileLogStorage storage{path, LogFileOptions{Durability::OsBuffered, {}, 1u << 20u, 512}};
+        auto writer = make_writer(540, NoOpReceiver, storage);
+
+        for (std::uint64_t t = 0; t < 10; ++t) {
+            Entity team{EntityDescriptor{writer.next_id(), 61}};
+            team.set_field("name", {std::string{"team "} + std::to_string(t)});
+            REQUIRE(writer.write_event(team));
+            teams.push_back(team.descriptor());
+        }
+        EntityDescriptor unwritten{writer.next_id(), 61};
+
+        for (std::uint64_t m = 0; m < 200; ++m) {
+            Entity member{EntityDescriptor{writer.next_id(), 62}};
+            member.set_field("seq", {m});
+            member.set_field("email", {std::to_string(m) + "@example.com"});
+            member.set_field("team_id", {teams[m % teams.size()]});
+            REQUIRE(writer.write_event(member));
+            members.push_back(member.descriptor());
+        }
+
+        //later versions move members between teams, drop refs, and point at a team never written
+        for (std::uint64_t m = 0; m < 200; m += 3) {
+            Entity member{members[m]};
+            member.set_field("seq", {m + 1000});
+            member.set_field("email", {std::to_string(m) + "@work.com"});
+            if (m % 2 == 0) {
+                member.set_field("team_id", {teams[(m + 1) % teams.size()]});
+            } else if (m % 5 == 0) {
+                member.set_field("team_id", {unwritten});
+            }
+            REQUIRE(writer.write_event(member));
+        }
+        for (std::uint64_t m = 0; m < 200; m += 7) {
+            Entity member{members[m]};
+            member.set_field("seq", {m + 2000});
+            member.set_field("email", {std::to_string(m) + "@home.com"});
+            member.set_field("team_id", {teams[m % teams.size()]});
+            REQUIRE(writer.write_event(member));
+        }
+        teams.push_back(unwritten);
+    }
+
+    //one writer, so the log is in EventID order and publishing it gives the state bulk replay must match
+    std::vector<IndexedField> indexed{IndexedField{62, "email"}};
+    auto live_store = std::make_shared<EntityStore>();
+    auto live_indexes = std::make_shared<FieldIndexes>(indexed);
+    PublisherImpl live_pub{live_store, nullptr, nullptr, live_indexes};
+    ViewReaderImpl live_reader{live_store, nullptr, live_indexes};
+    EventLog<FileLogStorage> log{[&](Event &&evt) { live_pub.publish(std::move(evt)); }, FileLogStorage{path}};
+    log.replay();
+
+    auto bulk_store = std::make_shared<EntityStore>();
+    auto bulk_indexes = std::make_shared<FieldIndexes>(indexed);
+    PublisherImpl bulk_pub{bulk_store, nullptr, nullptr, bulk_indexes};
+    ViewReaderImpl bulk_reader{bulk_store, nullptr, bulk_indexes};
+
+    FileLogStorage storage{path};
+    auto chunks = storage.chunks();
+    REQUIRE(chunks.size() > 4);
+    REQUIRE(bulk_pub.bulk_replay(chunks, 3) == 10 + 200 + 67 + 29);
+    REQUIRE(bulk_store->size() == live_store->size());
+
+    auto sorted = [](std::vector<PrimitiveFieldValue> values) {
+        std::vector<std::uint64_t> longs{};
+        for (auto &value : values) {
+            longs.push_back(value.as_long());
+        }
+        std::sort(longs.begin(), longs.end());
+        return longs;
+    };
+
+    ViewPath on_team{{"team_id", 62, false}, {"seq", 0, false}};
+    ViewPath name{{"name", 0, false}};
+    for (auto &team : teams) {
+        auto expected = live_reader.read_view(ViewDescriptor{team, {on_team, name}});
+        auto actual = bulk_reader.read_view(ViewDescriptor{team, {on_team, name}});
+        REQUIRE(expected);
+        REQUIRE(actual);
+        REQUIRE(sorted(actual->get_path_vals(on_team)) == sorted(expected->get_path_vals(on_team)));
+        REQUIRE(actual->get_path_vals(name) == expected->get_path_vals(name));
+    }
+
+    ViewPath team_name{{"team_id", 61, true}, {"name", 0, false}};
+    ViewPath seq{{"seq", 0, false}};
+    for (auto &member : members) {
+        auto expected = live_reader.read_view(ViewDescriptor{member, {seq, team_name}});
+        auto actual = bulk_reader.read_view(ViewDescriptor{member, {seq, team_name}});
+        REQUIRE(actual);
+        REQUIRE(actual->get_path_vals(seq) == expected->get_path_vals(seq));
+        REQUIRE(actual->get_path_vals(team_name) == expected->get_path_vals(team_name));
+    }
+    REQUIRE(bulk_reader.type_members(62).size() == 200);
+
+    //secondary indexes are rebuilt from what was loaded
+    ViewDescriptor by_email{};
+    by_email.paths = {seq};
+    by_email.lookup = IndexLookup{62, "email", {std::string{"3@work.com"}}};
+    REQUIRE(bulk_reader.read_view(by_email)->get_path_vals(seq)[0].as_long() == 1003);
+    by_email.lookup = IndexLookup{62, "email", {std::string{"3@example.com"}}};
+    REQUIRE(!bulk_reader.read_view(by_email));
+
+    //publishes after the load behave as they would on a live system
+    Entity moved{members[1]};
+    moved.set_field("seq", {1u});
+    moved.set_field("team_id", {teams[0]});
+    Event late{};
+    late.id = SnowflakeProvider<>{541}.next();
+    late.entity = moved;
+    bulk_pub.publish(Event{late});
+    live_pub.publish(Event{late});
+    auto team_view = bulk_reader.read_view(ViewDescriptor{teams[1], {on_team}});
+    REQUIRE(sorted(team_view->get_path_vals(on_team)) ==
+            sorted(live_reader.read_view(ViewDescriptor{teams[1], {on_team}})->get_path_vals(on_team)));
+
+    //a second load would clobber what is there
+    REQUIRE_THROWS(bulk_pub.bulk_replay(chunks, 3));
+
+    //through the system, the load runs as one task on the dispatch worker
+    auto system = make_eventview_system<5>();
+
+    //subscriptions and parked reads made before the load hear about it
+    std::mutex delivered_mutex{};
+    std::vector<std::uint64_t> delivered{};
+    auto subscribed = system.second.subscribe(ViewDescriptor{members[3], {seq}}, [&](EventID, const View &view) {
+        std::lock_guard<std::mutex> lock{delivered_mutex};
+        delivered.push_back(view.get_path_vals(seq)[0].as_long());
+    });
+    REQUIRE(subscribed);
+    auto parked = std::async(std::launch::async, [&]() {
+        return system.second.read_view(ViewDescriptor{members[6], {seq}, ExpectedEntity{members[6], 1}},
+                                       std::chrono::milliseconds{10000});
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+    auto load_started = std::chrono::steady_clock::now();
+    REQUIRE(*system.first.bulk_replay(chunks, 2) == 306);
+    {
+        std::lock_guard<std::mutex> lock{delivered_mutex};
+        REQUIRE(delivered == std::vector<std::uint64_t>{1003});
+    }
+    REQUIRE(parked.wait_for(std::chrono::seconds{5}) == std::future_status::ready);
+    REQUIRE(std::chrono::steady_clock::now() - load_started < std::chrono::seconds{5});
+    REQUIRE(parked.get()->get_path_vals(seq)[0].as_long() == 1006);
+    REQUIRE(system.second.read_view(ViewDescriptor{members[3], {seq}})->get_path_vals(seq)[0].as_long() == 1003);
+    REQUIRE(!system.first.bulk_replay(chunks, 2));
+    std::remove(path.c_str());
+}
+
+TEST_CASE("replay skipping superseded events") {
+    SnowflakeProvider<> ids{550};
+    //taken first, so a write logged last under it is older than everything else
+    auto stale_id = ids.next();
+
+    std::vector<Event> log{};
+    auto append = [&](const Entity &entity, EventID id) {
+        Event evt{};
+        evt.id = id;
+        evt.entity = entity;
+        log.push_back(std::move(evt));
+    };
+
+    std::vector<EntityDescriptor> teams{};
+    for (std::uint64_t t = 0; t < 5; ++t) {
+        Entity team{EntityDescriptor{ids.next(), 71}};
+        team.set_field("name", {std::string{"team "} + std::to_string(t)});
+        append(team, ids.next());
+        teams.push_back(team.descriptor());
+    }
+    //never written, only referenced
+    EntityDescriptor historic{ids.next(), 71};
+
+    std::vector<EntityDescriptor> members{};
+    for (std::uint64_t m = 0; m < 50; ++m) {
+        Entity member{EntityDescriptor{ids.next(), 72}};
+        member.set_field("seq", {m});
+        member.set_field("team_id", {teams[m % teams.size()]});
+        append(member, ids.next());
+        members.push_back(member.descriptor());
+    }
+    for (std::uint64_t m = 0; m < 50; m += 2) {
+        Entity member{members[m]};
+        member.set_field("seq", {m + 100});
+        member.set_field("team_id", {m % 10 == 0 ? historic : teams[(m + 1) % teams.size()]});
+        append(member, ids.next());
+    }
+    for (std::uint64_t m = 0; m < 50; m += 4) {
+        Entity member{members[m]};
+        member.set_field("seq", {m + 200});
+        append(member, ids.next());
+    }
+    teams.push_back(historic);
+
+    auto full_store = std::make_shared<EntityStore>();
+    PublisherImpl full_pub{full_store, nullptr, nullptr};
+    ViewReaderImpl full_reader{full_store, nullptr};
+    for (auto &evt : log) {
+        full_pub.publish(Event{evt});
+    }
+
+    auto latest_store = std::make_shared<EntityStore>();
+    PublisherImpl latest_pub{latest_store, nullptr, nullptr};
+    ViewReaderImpl latest_reader{latest_store, nullptr};
+    auto stats = latest_pub.replay_latest(log);
+    REQUIRE(stats.applied + stats.skipped == log.size());
+    REQUIRE(stats.skipped == 38);
+    REQUIRE(latest_store->size() == full_store->size());
+
+    auto sorted = [](std::vector<PrimitiveFieldValue> values) {
+        std::vector<std::uint64_t> longs{};
+        for (auto &value : values) {
+            longs.push_back(value.as_long());
+        }
+        std::sort(longs.begin(), longs.end());
+        return longs;
+    };
+
+    ViewPath on_team{{"team_id", 72, false}, {"seq", 0, false}};
+    for (auto &team : teams) {
+        auto expected = full_reader.read_view(ViewDescriptor{team, {on_team}});
+        auto actual = latest_reader.read_view(ViewDescriptor{team, {on_team}});
+        REQUIRE(expected);
+        REQUIRE(actual);
+        REQUIRE(sorted(actual->get_path_vals(on_team)) == sorted(expected->get_path_vals(on_team)));
+    }
+    //the team never written is a stub, referenced only by the members whose newest versions still point at it
+    auto historic_view = latest_reader.read_view(ViewDescriptor{historic, {on_team}});
+    REQUIRE(sorted(historic_view->get_path_vals(on_team)) == std::vector<std::uint64_t>{110, 130});
+
+    ViewPath team_name{{"team_id", 71, true}, {"name", 0, false}};
+    ViewPath seq{{"seq", 0, false}};
+    for (auto &member : members) {
+        auto expected = full_reader.read_view(ViewDescriptor{member, {seq, team_name}});
+        auto actual = latest_reader.read_view(ViewDescriptor{member, {seq, team_name}});
+        REQUIRE(actual);
+        REQUIRE(actual->get_path_vals(seq) == expected->get_path_vals(seq));
+        REQUIRE(actual->get_path_vals(team_name) == expected->get_path_vals(team_name));
+    }
+
+    REQUIRE_THROWS(latest_pub.replay_latest(log));
+
+    //a log whose ids go backwards still skips: the stale write is older than its entity's newest, so it loses
+    Entity stale{members[4]};
+    stale.set_field("seq", {4u});
+    stale.set_field("team_id", {teams[4]});
+    auto stale_log = log;
+    stale_log.push_back(Event{});
+    stale_log.back().id = stale_id;
+    stale_log.back().entity = stale;
+
+    auto stale_full = std::make_shared<EntityStore>();
+    PublisherImpl stale_full_pub{stale_full, nullptr, nullptr};
+    for (auto &evt : stale_log) {
+        stale_full_pub.publish(Event{evt});
+    }
+    auto stale_latest = std::make_shared<EntityStore>();
+    PublisherImpl stale_latest_pub{stale_latest, nullptr, nullptr};
+    auto stale_stats = stale_latest_pub.replay_latest(stale_log);
+    REQUIRE(stale_stats.skipped == 38);
+    REQUIRE(stale_stats.unordered == 0);
+
+    for (auto &team : teams) {
+        auto expected = ViewReaderImpl{stale_full, nullptr}.read_view(ViewDescriptor{team, {on_team}});
+        auto actual = ViewReaderImpl{stale_latest, nullptr}.read_view(ViewDescriptor{team, {on_team}});
+        REQUIRE(sorted(actual->get_path_vals(on_team)) == sorted(expected->get_path_vals(on_team)));
+        for (auto &value : actual->get_path_vals(on_team)) {
+            REQUIRE(value.as_long() != 4);
+        }
+    }
+
+    /*
+     * Writers sharing a log interleave their ids. A ref logged ahead of an older version rejects it, whether the
+     * ref is added (b to a) or removed (r's second version dropping e), so a and e are published in full while c
+     * and r, whose versions no ref decides, still skip.
+     */
+    std::vector<Event> interleaved{};
+    Entity first_a{EntityDescriptor{900, 71}};
+    first_a.set_field("name", {std::string{"a1"}});
+    Entity ref_b{EntityDescriptor{901, 72}};
+    ref_b.set_field("team_id", {first_a.descriptor()});
+    Entity second_a{first_a.descriptor()};
+    second_a.set_field("name", {std::string{"a2"}});
+    Entity first_c{EntityDescriptor{902, 71}};
+    first_c.set_field("name", {std::string{"c1"}});
+    Entity second_c{first_c.descriptor()};
+    second_c.set_field("name", {std::string{"c2"}});
+    Entity first_e{EntityDescriptor{903, 71}};
+    first_e.set_field("name", {std::string{"e1"}});
+    Entity second_e{first_e.descriptor()};
+    second_e.set_field("name", {std::string{"e2"}});
+    Entity first_r{EntityDescriptor{904, 72}};
+    first_r.set_field("team_id", {first_e.descriptor()});
+    Entity second_r{first_r.descriptor()};
+    second_r.set_field("seq", {2u});
+    for (auto &entry : std::vector<std::pair<EventID, Entity>>{{10, first_a}, {30, ref_b}, {20, second_a},
+                                                                {5, first_c}, {6, first_e}, {11, first_r},
+                                                                {60, second_r}, {50, second_e}, {40, second_c}}) {
+        Event evt{};
+        evt.id = entry.first;
+        evt.entity = entry.second;
+        interleaved.push_back(std::move(evt));
+    }
+
+    auto interleaved_full = std::make_shared<EntityStore>();
+    PublisherImpl interleaved_full_pub{interleaved_full, nullptr, nullptr};
+    for (auto &evt : interleaved) {
+        interleaved_full_pub.publish(Event{evt});
+    }
+    auto interleaved_latest = std::make_shared<EntityStore>();
+    PublisherImpl interleaved_latest_pub{interleaved_latest, nullptr, nullptr};
+    auto interleaved_stats = interleaved_latest_pub.replay_latest(interleaved);
+    REQUIRE(interleaved_stats.unordered == 2);
+    REQUIRE(interleaved_stats.skipped == 2);
+    REQUIRE(interleaved_stats.applied == interleaved.size() - 2);
+
+    ViewPath a_name{{"name", 0, false}};
+    ViewPath named_by{{"team_id", 72, false}, {"team_id", 71, true}, {"name", 0, false}};
+    std::vector<EntityDescriptor> named_entities{first_a.descriptor(), first_c.descriptor(), first_e.descriptor()};
+    std::vector<std::string> expected_names{"a1", "c2", "e1"};
+    for (std::size_t i = 0; i < expected_names.size(); ++i) {
+        auto &named = named_entities[i];
+        auto expected = ViewReaderImpl{interleaved_full, nullptr}.read_view(ViewDescriptor{named, {a_name, named_by}});
+        auto actual = ViewReaderImpl{interleaved_latest, nullptr}.read_view(ViewDescriptor{named, {a_name, named_by}});
+        REQUIRE(actual);
+        REQUIRE(actual->get_path_vals(a_name) == expected->get_path_vals(a_name));
+        REQUIRE(actual->get_path_vals(named_by) == expected->get_path_vals(named_by));
+        REQUIRE(actual->get_path_vals(a_name)[0].as_string() == expected_names[i]);
+    }
+
+    //through the system, reads parked on a replayed version are woken once the replay is in
+    auto system = make_eventview_system<5>();
+    auto parked = std::async(std::launch::async, [&]() {
+        return system.second.read_view(ViewDescriptor{members[8], {seq}, ExpectedEntity{members[8], 1}},
+                                       std::chrono::milliseconds{10000});
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+
+    auto replay_started = std::chrono::steady_clock::now();
+    auto through = system.first.replay_latest(log);
+    REQUIRE(through);
+    REQUIRE(through->skipped == 38);
+    REQUIRE(parked.wait_for(std::chrono::seconds{5}) == std::future_status::ready);
+    REQUIRE(std::chrono::steady_clock::now() - replay_started < std::chrono::seconds{5});
+    REQUIRE(parked.get()->get_path_vals(seq)[0].as_long() == 208);
+    REQUIRE(system.second.read_view(ViewDescriptor{members[4], {seq}})->get_path_vals(seq)[0].as_long() == 204);
+    REQUIRE(!system.first.replay_latest(log));
+}
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <cmath>
+#include <cstring>
 #include <string>
 #include <variant>
 #include <unordered_map>
@@ -10,6 +11,9 @@
 #include <functional>
 #include <optional>
 #include <numeric>
+#include <memory>
+#include <array>
+#include <stdexcept>
 
 namespace eventview {
 
@@ -28,10 +32,161 @@ namespace eventview {
         return lhs.id == rhs.id && lhs.type == rhs.type;
     }
 
+    struct PrimitiveFieldValue {
+        std::variant<std::uint64_t, std::double_t, std::string, bool, EntityDescriptor> val;
+
+        bool is_long() const {
+            return std::holds_alternative<std::uint64_t>(val);
+        }
+
+        const std::uint64_t &as_long() const {
+            return *std::get_if<std::uint64_t>(&val);
+        }
+
+        bool is_double() const {
+            return std::holds_alternative<std::double_t>(val);
+        }
+
+        const std::double_t &as_double() const {
+            return *std::get_if<std::double_t>(&val);
+        }
+
+        bool is_string() const {
+            return std::holds_alternative<std::string>(val);
+        }
+
+        const std::string &as_string() const {
+            return *std::get_if<std::string>(&val);
+        }
+
+        bool is_descriptor() const {
+            return std::holds_alternative<EntityDescriptor>(val);
+        }
+
+        const EntityDescriptor &as_descriptor() const {
+            return *std::get_if<EntityDescriptor>(&val);
+        }
+
+    };
+
+    inline bool operator==(const PrimitiveFieldValue &lhs, const PrimitiveFieldValue &rhs) {
+        return lhs.val == rhs.val;
+    }
+
+    /*
+     * A condition on one field of the entity a path element reaches. Equality works on any value, ranges are
+     * inclusive and need both bounds of the field's own type (uint64_t or double), prefixes apply to strings.
+     */
+    struct FieldPredicate {
+        enum class Op {
+            Equals,
+            Range,
+            Prefix
+        };
+
+        std::string field;
+        Op op;
+        PrimitiveFieldValue value;
+        PrimitiveFieldValue upper;
+
+        static FieldPredicate equals(std::string field, PrimitiveFieldValue value) {
+            return FieldPredicate{std::move(field), Op::Equals, std::move(value), {}};
+        }
+
+        static FieldPredicate range(std::string field, PrimitiveFieldValue lower, PrimitiveFieldValue upper) {
+            return FieldPredicate{std::move(field), Op::Range, std::move(lower), std::move(upper)};
+        }
+
+        static FieldPredicate prefix(std::string field, std::string prefix) {
+            return FieldPredicate{std::move(field), Op::Prefix, {std::move(prefix)}, {}};
+        }
+
+        bool matches(const std::unordered_map<std::string, PrimitiveFieldValue> &fields) const {
+            auto found = fields.find(field);
+            if (found == fields.end()) {
+                return false;
+            }
+
+            auto &actual = found->second;
+            switch (op) {
+                case Op::Equals:
+                    return actual == value;
+                case Op::Range:
+                    if (actual.is_long() && value.is_long() && upper.is_long()) {
+                        return value.as_long() <= actual.as_long() && actual.as_long() <= upper.as_long();
+                    }
+                    if (actual.is_double() && value.is_double() && upper.is_double()) {
+                        return value.as_double() <= actual.as_double() && actual.as_double() <= upper.as_double();
+                    }
+                    return false;
+                case Op::Prefix:
+                    return actual.is_string() && value.is_string() &&
+                           actual.as_string().compare(0, value.as_string().size(), value.as_string()) == 0;
+            }
+
+            return false;
+        }
+    };
+
+    inline bool operator==(const FieldPredicate &lhs, const FieldPredicate &rhs) {
+        return lhs.field == rhs.field && lhs.op == rhs.op && lhs.value == rhs.value && lhs.upper == rhs.upper;
+    }
+
+    //reduces every value a path reaches to a single value; only valid on the final value element
+    enum class Aggregate {
+        None,
+        Count,
+        Sum,
+        Min,
+        Max,
+        Avg
+    };
+
+    //the order a reverse ref visits its referencers in; None walks them by id, which is what cursors page over
+    enum class RefOrder {
+        None,
+        Newest,
+        Oldest,
+        Highest,
+        Lowest
+    };
+
+    inline const char *aggregate_suffix(Aggregate aggregate) {
+        switch (aggregate) {
+            case Aggregate::Count:
+                return ":count";
+            case Aggregate::Sum:
+                return ":sum";
+            case Aggregate::Min:
+                return ":min";
+            case Aggregate::Max:
+                return ":max";
+            case Aggregate::Avg:
+                return ":avg";
+            default:
+                return "";
+        }
+    }
+
     struct PathElement {
         std::string name;
         EntityTypeID type;
         bool forward;
+        //reverse refs only: at most limit referencers (0 for all) with ids after the given resume cursor
+        std::size_t limit = 0;
+        EntityID after = 0;
+        //checked against the entity this element reaches before descending or emitting
+        std::vector<FieldPredicate> filters{};
+        //a Count with an empty name counts the entities reached by the previous element instead of a field
+        Aggregate aggregate = Aggregate::None;
+        //reverse refs only: Newest and Oldest go by edge write time, Highest and Lowest by the numeric order_by field
+        RefOrder order = RefOrder::None;
+        std::string order_by{};
+        /*
+         * refs and reverse refs only: follow the hop transitively up to repeat times (0 follows it once) and evaluate
+         * the rest of the path at every entity reached, visiting each entity at most once
+         */
+        std::size_t repeat = 0;
 
         const bool is_ref() const {
             return type >= 0 && forward;
@@ -47,20 +202,83 @@ namespace eventview {
     };
 
     inline bool operator==(const PathElement &lhs, const PathElement &rhs) {
-        return lhs.name == rhs.name && lhs.type == rhs.type && lhs.forward == rhs.forward;
+        return lhs.name == rhs.name && lhs.type == rhs.type && lhs.forward == rhs.forward &&
+               lhs.limit == rhs.limit && lhs.after == rhs.after && lhs.filters == rhs.filters &&
+               lhs.aggregate == rhs.aggregate && lhs.order == rhs.order && lhs.order_by == rhs.order_by &&
+               lhs.repeat == rhs.repeat;
     }
 
 
     using ViewPath = std::vector<PathElement>;
 
+    //appends a value to a path key tagged with its type, strings length prefixed, so distinct values never collide
+    inline void append_key_value(std::string &key, const PrimitiveFieldValue &value) {
+        if (value.is_long()) {
+            key.append("l").append(std::to_string(value.as_long()));
+        } else if (value.is_double()) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &value.as_double(), sizeof(bits));
+            key.append("d").append(std::to_string(bits));
+        } else if (value.is_string()) {
+            auto &str = value.as_string();
+            key.append("s").append(std::to_string(str.size())).append(":").append(str);
+        } else if (value.is_descriptor()) {
+            auto &desc = value.as_descriptor();
+            key.append("e").append(std::to_string(desc.id)).append("/").append(std::to_string(desc.type));
+        } else {
+            key.append(std::get<bool>(value.val) ? "t" : "f");
+        }
+    }
+
+    /*
+     * Appends what an element reaches by besides its name: filters, paging, order and repeat. Elements that set
+     * none of them add nothing, so plain paths keep their dotted keys.
+     */
+    inline void append_key_params(std::string &key, const PathElement &elem) {
+        if (elem.filters.empty() && elem.limit == 0 && elem.after == 0 && elem.order == RefOrder::None &&
+            elem.repeat == 0) {
+            return;
+        }
+
+        key.append("[");
+        if (elem.limit > 0) {
+            key.append("limit=").append(std::to_string(elem.limit)).append(";");
+        }
+        if (elem.after > 0) {
+            key.append("after=").append(std::to_string(elem.after)).append(";");
+        }
+        if (elem.order != RefOrder::None) {
+            key.append("order=").append(std::to_string(static_cast<int>(elem.order))).append(":");
+            key.append(std::to_string(elem.order_by.size())).append(":").append(elem.order_by).append(";");
+        }
+        if (elem.repeat > 0) {
+            key.append("repeat=").append(std::to_string(elem.repeat)).append(";");
+        }
+        for (auto &filter : elem.filters) {
+            key.append("filter=").append(std::to_string(filter.field.size())).append(":").append(filter.field);
+            key.append(std::to_string(static_cast<int>(filter.op)));
+            append_key_value(key, filter.value);
+            if (filter.op == FieldPredicate::Op::Range) {
+                append_key_value(key, filter.upper);
+            }
+            key.append(";");
+        }
+        key.append("]");
+    }
+
     inline const std::string path_to_string(const ViewPath &path) {
         std::string str;
         for (int i=0; i<path.size(); ++i) {
             str.append(path[i].name);
+            append_key_params(str, path[i]);
             if (i<path.size()-1) {
                 str.append(".");
             }
         }
+        //aggregated paths get their own key so they never share a slot with the plain path
+        if (!path.empty()) {
+            str.append(aggregate_suffix(path.back().aggregate));
+        }
         return std::move(str);
     }
 
@@ -80,52 +298,273 @@ namespace eventview {
     };
 
 
+    enum class IndexKind {
+        //hashed, answers lookups only
+        Equality,
+        //sorted by value, answers lookups, range scans and, over string fields, prefix scans
+        Ordered
+    };
+
+    //a (type, field) pair to keep a secondary index over
+    struct IndexedField {
+        EntityTypeID type;
+        std::string field;
+        IndexKind kind = IndexKind::Equality;
+    };
+
+    //finds a root by an indexed field value instead of by descriptor
+    struct IndexLookup {
+        EntityTypeID type;
+        std::string field;
+        PrimitiveFieldValue value;
+    };
+
+    inline bool operator==(const IndexLookup &lhs, const IndexLookup &rhs) {
+        return lhs.type == rhs.type && lhs.field == rhs.field && lhs.value == rhs.value;
+    }
+
+    //position in an ordered index, resumed after by the next page of a scan
+    struct ScanCursor {
+        PrimitiveFieldValue value;
+        EntityID id;
+    };
+
+    inline bool operator==(const ScanCursor &lhs, const ScanCursor &rhs) {
+        return lhs.value == rhs.value && lhs.id == rhs.id;
+    }
+
+    /*
+     * A page of the entities of one type whose ordered-index field lies between lower and upper, both inclusive and
+     * open when unset, in (value, id) order. A prefix further restricts the page to string values starting with it.
+     */
+    struct RangeScan {
+        EntityTypeID type;
+        std::string field;
+        std::optional<PrimitiveFieldValue> lower{};
+        std::optional<PrimitiveFieldValue> upper{};
+        std::size_t limit = 100;
+        std::optional<ScanCursor> after{};
+        std::optional<std::string> prefix{};
+
+        //typeahead form: at most limit entities whose field starts with prefix
+        static RangeScan starting_with(EntityTypeID type, std::string field, std::string prefix, std::size_t limit) {
+            return RangeScan{type, std::move(field), {}, {}, limit, {}, std::move(prefix)};
+        }
+    };
+
+    inline bool operator==(const RangeScan &lhs, const RangeScan &rhs) {
+        return lhs.type == rhs.type && lhs.field == rhs.field && lhs.lower == rhs.lower && lhs.upper == rhs.upper &&
+               lhs.limit == rhs.limit && lhs.after == rhs.after && lhs.prefix == rhs.prefix;
+    }
+
+
+    class ViewPlan;
+
     struct ViewDescriptor {
-        EntityDescriptor root;
-        std::vector<ViewPath> paths;
-        std::optional<ExpectedEntity> expectation;
+        EntityDescriptor root{};
+        std::vector<ViewPath> paths{};
+        std::optional<ExpectedEntity> expectation{};
+        //when set, the prepared plan is executed and paths are ignored
+        std::shared_ptr<const ViewPlan> plan{};
+        //when set, root is ignored and resolved through a secondary index at read time
+        std::optional<IndexLookup> lookup{};
+        //when set, root is ignored; read_view takes the first match and scan_views evaluates the paths for the page
+        std::optional<RangeScan> range{};
     };
 
-    struct PrimitiveFieldValue {
-        std::variant<std::uint64_t, std::double_t, std::string, bool, EntityDescriptor> val;
+    inline bool operator==(const ExpectedEntity &lhs, const ExpectedEntity &rhs) {
+        return lhs.expected == rhs.expected && lhs.minimum_write == rhs.minimum_write;
+    }
 
-        bool is_long() const {
-            return std::holds_alternative<std::uint64_t>(val);
+    //plans compare by identity, so two descriptors only match when they share the prepared plan
+    inline bool operator==(const ViewDescriptor &lhs, const ViewDescriptor &rhs) {
+        return lhs.root == rhs.root && lhs.plan == rhs.plan && lhs.expectation == rhs.expectation &&
+               lhs.lookup == rhs.lookup && lhs.range == rhs.range && lhs.paths == rhs.paths;
+    }
+
+
+    constexpr std::uint64_t FNV_OFFSET = 14695981039346656037ull;
+    constexpr std::uint64_t FNV_PRIME = 1099511628211ull;
+
+    constexpr std::uint64_t fnv_append(std::uint64_t hash, const char *str, std::size_t len) {
+        for (std::size_t i = 0; i < len; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(str[i])) * FNV_PRIME;
         }
+        return hash;
+    }
 
-        const std::uint64_t &as_long() const {
-            return *std::get_if<std::uint64_t>(&val);
+    /*
+     * A dotted path key whose hash is computed at compile time when the key is constexpr, e.g.
+     *   static constexpr auto manager_name = "manager_id"_p / "name"_p;
+     * Lookups with it cost a single probe on the precomputed hash plus a comparison of the segments.
+     */
+    class PathKey final {
+    public:
+        static constexpr std::size_t MaxDepth = 8;
+
+        struct Segment {
+            const char *str;
+            std::size_t len;
+        };
+
+        constexpr PathKey(const char *str, std::size_t len) : segments_{}, depth_{1},
+                                                              hash_{fnv_append(FNV_OFFSET, str, len)} {
+            segments_[0] = Segment{str, len};
         }
 
-        bool is_double() const {
-            return std::holds_alternative<std::double_t>(val);
+        constexpr PathKey operator/(const PathKey &rhs) const {
+            if (depth_ + rhs.depth_ > MaxDepth) {
+                throw std::length_error{"path key too deep"};
+            }
+
+            PathKey joined{*this};
+            for (std::size_t i = 0; i < rhs.depth_; ++i) {
+                auto &seg = rhs.segments_[i];
+                joined.hash_ = fnv_append(fnv_append(joined.hash_, ".", 1), seg.str, seg.len);
+                joined.segments_[joined.depth_++] = seg;
+            }
+            return joined;
         }
 
-        const std::double_t &as_double() const {
-            return *std::get_if<std::double_t>(&val);
+        constexpr std::uint64_t hash() const {
+            return hash_;
         }
 
-        bool is_string() const {
-            return std::holds_alternative<std::string>(val);
+        bool matches(const std::string &key) const {
+            std::size_t pos = 0;
+            for (std::size_t i = 0; i < depth_; ++i) {
+                if (i > 0) {
+                    if (pos >= key.size() || key[pos] != '.') {
+                        return false;
+                    }
+                    ++pos;
+                }
+
+                auto &seg = segments_[i];
+                if (key.compare(pos, seg.len, seg.str, seg.len) != 0) {
+                    return false;
+                }
+                pos += seg.len;
+            }
+            return pos == key.size();
         }
 
-        const std::string &as_string() const {
-            return *std::get_if<std::string>(&val);
+        std::string to_string() const {
+            std::string key{};
+            for (std::size_t i = 0; i < depth_; ++i) {
+                if (i > 0) {
+                    key.push_back('.');
+                }
+                key.append(segments_[i].str, segments_[i].len);
+            }
+            return key;
         }
 
-        bool is_descriptor() const {
-            return std::holds_alternative<EntityDescriptor>(val);
+    private:
+        std::array<Segment, MaxDepth> segments_;
+        std::size_t depth_;
+        std::uint64_t hash_;
+    };
+
+    namespace path_literals {
+
+        constexpr PathKey operator""_p(const char *str, std::size_t len) {
+            return PathKey{str, len};
         }
 
-        const EntityDescriptor &as_descriptor() const {
-            return *std::get_if<EntityDescriptor>(&val);
+    }
+
+    /*
+     * Maps dotted path keys to the result slot that holds their values. A plan builds one index and shares it with
+     * every View it produces, so keys are hashed once per plan rather than once per value.
+     */
+    class PathIndex final {
+    public:
+        PathIndex() = default;
+        PathIndex(const PathIndex &)=default;
+        PathIndex& operator=(const PathIndex &)=default;
+        PathIndex(PathIndex &&)=default;
+        PathIndex& operator=(PathIndex &&)=default;
+        ~PathIndex()=default;
+
+        std::uint32_t add(const std::string &key) {
+            auto found = slots_.find(key);
+            if (found != slots_.end()) {
+                return found->second;
+            }
+
+            auto slot = static_cast<std::uint32_t>(slots_.size());
+            slots_.emplace(key, slot);
+            keys_.push_back(key);
+            //the first key keeps the hash; keys that collide with it are found through the string map instead
+            if (!by_hash_.emplace(fnv_append(FNV_OFFSET, key.data(), key.size()), slot).second) {
+                collided_ = true;
+            }
+            return slot;
+        }
+
+        std::optional<std::uint32_t> find(const std::string &key) const {
+            auto found = slots_.find(key);
+            if (found == slots_.end()) {
+                return {};
+            }
+            return found->second;
         }
 
+        std::optional<std::uint32_t> find(const PathKey &key) const {
+            auto found = by_hash_.find(key.hash());
+            if (found != by_hash_.end() && key.matches(keys_[found->second])) {
+                return found->second;
+            }
+            if (collided_ && found != by_hash_.end()) {
+                return find(key.to_string());
+            }
+            return {};
+        }
+
+        std::size_t size() const {
+            return slots_.size();
+        }
+
+    private:
+        std::unordered_map<std::string, std::uint32_t> slots_;
+        std::unordered_map<std::uint64_t, std::uint32_t> by_hash_;
+        std::vector<std::string> keys_;
+        bool collided_ = false;
     };
 
-    inline bool operator==(const PrimitiveFieldValue &lhs, const PrimitiveFieldValue &rhs) {
-        return lhs.val == rhs.val;
-    }
+    struct PathHandle {
+        std::uint32_t slot;
+    };
+
+    class ValueSpan final {
+    public:
+        ValueSpan(const PrimitiveFieldValue *begin, const PrimitiveFieldValue *end) : begin_{begin}, end_{end} {}
+
+        const PrimitiveFieldValue *begin() const {
+            return begin_;
+        }
+
+        const PrimitiveFieldValue *end() const {
+            return end_;
+        }
+
+        std::size_t size() const {
+            return static_cast<std::size_t>(end_ - begin_);
+        }
+
+        bool empty() const {
+            return begin_ == end_;
+        }
+
+        const PrimitiveFieldValue &operator[](std::size_t idx) const {
+            return begin_[idx];
+        }
+
+    private:
+        const PrimitiveFieldValue *begin_;
+        const PrimitiveFieldValue *end_;
+    };
 
     class ViewBuilder;
 
@@ -138,52 +577,87 @@ namespace eventview {
         View& operator=(View &&)=default;
         ~View()=default;
 
-        const std::optional<PrimitiveFieldValue> get_path_val(const ViewPath &path) const {
-            assert(path.size() > 0);
+        const EntityDescriptor &descriptor() const {
+            return descriptor_;
+        }
 
-            auto found =  values_.find(path_to_string(path));
-            if (found == values_.end()) {
+        //handles are stable for every view produced from the same plan or the same descriptor paths
+        std::optional<PathHandle> handle(const ViewPath &path) const {
+            auto slot = index_->find(path_to_string(path));
+            if (!slot) {
                 return {};
-            } else {
-                return found->second;
             }
+            return PathHandle{*slot};
         }
 
-        const std::vector<PrimitiveFieldValue> get_path_vals(const ViewPath &path) const {
-            assert(path.size() > 0);
+        ValueSpan values(PathHandle handle) const {
+            if (!body_ || handle.slot + 1 >= body_->offsets.size()) {
+                return {nullptr, nullptr};
+            }
 
-            std::vector<PrimitiveFieldValue> vals{};
-            auto founds = values_.equal_range(path_to_string(path));
-            for (auto i = founds.first; i != founds.second; i++) {
-                vals.push_back(i->second);
+            auto base = body_->values.data();
+            return {base + body_->offsets[handle.slot], base + body_->offsets[handle.slot + 1]};
+        }
+
+        const PrimitiveFieldValue *value(PathHandle handle) const {
+            auto vals = values(handle);
+            return vals.empty() ? nullptr : vals.begin();
+        }
+
+        //set when a paged reverse-ref on the path stopped at its limit; pass it as the element's after to resume
+        std::optional<EntityID> next_cursor(PathHandle handle) const {
+            if (!body_) {
+                return {};
             }
+            for (auto &cursor : body_->cursors) {
+                if (cursor.first == handle.slot) {
+                    return cursor.second;
+                }
+            }
+            return {};
+        }
+
+        const PrimitiveFieldValue *get(const PathKey &key) const {
+            auto slot = index_->find(key);
+            return slot ? value(PathHandle{*slot}) : nullptr;
+        }
+
+        ValueSpan get_all(const PathKey &key) const {
+            auto slot = index_->find(key);
+            return slot ? values(PathHandle{*slot}) : ValueSpan{nullptr, nullptr};
+        }
+
+        //typed access without copying, nullptr when the path is absent or holds another type
+        template<typename T>
+        const T *get_as(const PathKey &key) const {
+            auto found = get(key);
+            return found ? std::get_if<T>(&found->val) : nullptr;
+        }
+
+        const std::optional<PrimitiveFieldValue> get_path_val(const ViewPath &path) const {
+            assert(path.size() > 0);
+
+            return first_(index_->find(path_to_string(path)));
+        }
+
+        const std::vector<PrimitiveFieldValue> get_path_vals(const ViewPath &path) const {
+            assert(path.size() > 0);
 
-            return std::move(vals);
+            return all_(index_->find(path_to_string(path)));
         }
 
         template<std::size_t size>
         const std::optional<PrimitiveFieldValue> get_path_val(const std::array<std::string, size> &path) const {
             assert(path.size() > 0);
 
-            auto found =  values_.find(path_str_(path));
-            if (found == values_.end()) {
-                return {};
-            } else {
-                return found->second;
-            }
+            return first_(index_->find(path_str_(path)));
         }
 
         template<std::size_t size>
         const std::vector<PrimitiveFieldValue> get_path_vals(const std::array<std::string, size> &path) const {
             assert(path.size() > 0);
 
-            std::vector<PrimitiveFieldValue> vals{};
-            auto founds = values_.equal_range(path_str_(path));
-            for (auto i = founds.first; i != founds.second; i++) {
-                vals.push_back(i->second);
-            }
-
-            return std::move(vals);
+            return all_(index_->find(path_str_(path)));
         }
 
     private:
@@ -201,18 +675,51 @@ namespace eventview {
             return std::move(str);
         }
 
+        const std::optional<PrimitiveFieldValue> first_(std::optional<std::uint32_t> slot) const {
+            if (slot) {
+                auto found = value(PathHandle{*slot});
+                if (found) {
+                    return *found;
+                }
+            }
+            return {};
+        }
+
+        const std::vector<PrimitiveFieldValue> all_(std::optional<std::uint32_t> slot) const {
+            if (slot) {
+                auto vals = values(PathHandle{*slot});
+                return {vals.begin(), vals.end()};
+            }
+            return {};
+        }
+
 
         friend class ViewBuilder;
-        explicit View(EntityDescriptor descriptor): descriptor_{descriptor}{}
+        View(EntityDescriptor descriptor, std::shared_ptr<const PathIndex> index): descriptor_{descriptor},
+            index_{std::move(index)}{}
+        //laid out once by ViewBuilder and never changed, so copies of a view, cached ones included, share it
+        struct Body {
+            //values grouped by slot; slot i occupies [offsets[i], offsets[i+1])
+            std::vector<PrimitiveFieldValue> values;
+            std::vector<std::uint32_t> offsets;
+            std::vector<std::pair<std::uint32_t, EntityID>> cursors;
+        };
+
         EntityDescriptor descriptor_;
-        std::unordered_multimap<std::string, PrimitiveFieldValue> values_;
+        std::shared_ptr<const PathIndex> index_;
+        std::shared_ptr<const Body> body_;
     };
 
 
     class ViewBuilder final {
     public:
-        explicit ViewBuilder(EntityDescriptor descriptor): view_{descriptor}{}
-        ViewBuilder(EntityDescriptor descriptor, std::optional<ExpectedEntity> expectation): view_{descriptor}, expectation_{expectation}{}
+        explicit ViewBuilder(EntityDescriptor descriptor): ViewBuilder(descriptor, {}){}
+        ViewBuilder(EntityDescriptor descriptor, std::optional<ExpectedEntity> expectation):
+            descriptor_{descriptor}, expectation_{expectation}, owned_index_{std::make_shared<PathIndex>()},
+            index_{owned_index_}{}
+        ViewBuilder(EntityDescriptor descriptor, std::optional<ExpectedEntity> expectation,
+                    std::shared_ptr<const PathIndex> index):
+            descriptor_{descriptor}, expectation_{expectation}, index_{std::move(index)}{}
         ViewBuilder(const ViewBuilder &)=default;
         ViewBuilder& operator=(const ViewBuilder &)=default;
         ViewBuilder(ViewBuilder &&)=default;
@@ -220,7 +727,22 @@ namespace eventview {
         ~ViewBuilder()=default;
 
         void add_path_val(ViewPath path, PrimitiveFieldValue value) {
-            view_.values_.insert({path_to_string(path), value});
+            assert(owned_index_);
+            add_slot_val(owned_index_->add(path_to_string(path)), std::move(value));
+        }
+
+        void add_slot_val(std::uint32_t slot, PrimitiveFieldValue value) {
+            pending_.emplace_back(slot, std::move(value));
+        }
+
+        void set_cursor(std::uint32_t slot, EntityID cursor) {
+            for (auto &existing : cursors_) {
+                if (existing.first == slot) {
+                    existing.second = cursor;
+                    return;
+                }
+            }
+            cursors_.emplace_back(slot, cursor);
         }
 
         const std::optional<ExpectedEntity> expectation() {
@@ -237,7 +759,7 @@ namespace eventview {
 
         std::optional<View> finish() {
             if (expectation_met()) {
-                return std::move(view_);
+                return layout_();
             } else {
                 return {};
             }
@@ -245,10 +767,114 @@ namespace eventview {
 
     private:
 
-        View view_;
+        //counting sort of the emitted values into one contiguous block grouped by slot
+        View layout_() {
+            View view{descriptor_, index_};
+            auto body = std::make_shared<View::Body>();
+
+            body->offsets.assign(index_->size() + 1, 0);
+            for (auto &slot_val : pending_) {
+                ++body->offsets[slot_val.first + 1];
+            }
+            for (std::size_t i = 1; i < body->offsets.size(); ++i) {
+                body->offsets[i] += body->offsets[i - 1];
+            }
+
+            std::vector<std::uint32_t> cursor{body->offsets.begin(), body->offsets.end() - 1};
+            body->values.resize(pending_.size());
+            for (auto &slot_val : pending_) {
+                body->values[cursor[slot_val.first]++] = std::move(slot_val.second);
+            }
+            pending_.clear();
+            body->cursors = std::move(cursors_);
+
+            view.body_ = std::move(body);
+            return view;
+        }
+
+        EntityDescriptor descriptor_;
         std::optional<ExpectedEntity> expectation_;
-        bool expectation_met_;
+        bool expectation_met_{false};
+        std::shared_ptr<PathIndex> owned_index_;
+        std::shared_ptr<const PathIndex> index_;
+        std::vector<std::pair<std::uint32_t, PrimitiveFieldValue>> pending_;
+        std::vector<std::pair<std::uint32_t, EntityID>> cursors_;
+
+    };
 
+
+    /*
+     * One column of a ColumnarView: every value for a path across all rows, with row r occupying
+     * [offsets[r], offsets[r+1]) so multi-valued paths need no per-row container.
+     */
+    struct Column {
+        std::vector<PrimitiveFieldValue> values;
+        std::vector<std::uint32_t> offsets;
+    };
+
+    /*
+     * Result of evaluating one plan for many roots. Rows follow the order of the requested roots and columns are
+     * addressed with the same handles as a View from that plan.
+     */
+    class ColumnarView final {
+    public:
+        ColumnarView(std::vector<EntityDescriptor> roots, std::vector<bool> found, std::shared_ptr<const PathIndex> index,
+                     std::vector<Column> columns) : roots_{std::move(roots)}, found_{std::move(found)},
+                                                   index_{std::move(index)}, columns_{std::move(columns)} {}
+
+        ColumnarView(const ColumnarView &)=default;
+        ColumnarView& operator=(const ColumnarView &)=default;
+        ColumnarView(ColumnarView &&)=default;
+        ColumnarView& operator=(ColumnarView &&)=default;
+        ~ColumnarView()=default;
+
+        std::size_t rows() const {
+            return roots_.size();
+        }
+
+        const EntityDescriptor &root(std::size_t row) const {
+            return roots_[row];
+        }
+
+        //false when the root for the row does not exist
+        bool found(std::size_t row) const {
+            return found_[row];
+        }
+
+        const Column &column(PathHandle handle) const {
+            return columns_[handle.slot];
+        }
+
+        ValueSpan values(PathHandle handle, std::size_t row) const {
+            auto &col = columns_[handle.slot];
+            auto base = col.values.data();
+            return {base + col.offsets[row], base + col.offsets[row + 1]};
+        }
+
+        std::optional<PathHandle> handle(const ViewPath &path) const {
+            auto slot = index_->find(path_to_string(path));
+            if (!slot) {
+                return {};
+            }
+            return PathHandle{*slot};
+        }
+
+    private:
+        std::vector<EntityDescriptor> roots_;
+        std::vector<bool> found_;
+        std::shared_ptr<const PathIndex> index_;
+        std::vector<Column> columns_;
+    };
+
+    struct ColumnRequest {
+        std::shared_ptr<const ViewPlan> plan;
+        std::vector<EntityDescriptor> roots;
+    };
+
+    //one page of a scan: a view per matching entity, and where to resume when the page was cut at its limit
+    struct ScanResult {
+        std::vector<View> views;
+        std::optional<ScanCursor> next;
     };
 
 
@@ -318,6 +944,12 @@ namespace eventview {
 
     using ViewCallback = std::function<void(EventID, const View &)>;
 
+    //receives streamed values for one path slot at a time, in chunks
+    using ChunkVisitor = std::function<void(PathHandle, ValueSpan)>;
+
+    //called concurrently from the scan's threads, once per entity of the scanned type
+    using ScanVisitor = std::function<void(const View &view)>;
+
     using EventReceiver = std::function<void(Event evt)>;
 
 }
@@ -343,7 +975,39 @@ namespace std {
             using std::uint64_t;
 
             return (((hash<string>()(pe.name) ^ hash<uint64_t>()(pe.type) << 1ull) >> 1ull) ^
-                    hash<bool>()(pe.forward) << 1ull);
+                    hash<bool>()(pe.forward) << 1ull) ^ (hash<uint64_t>()(pe.limit) * 31u) ^
+                    (hash<uint64_t>()(pe.after) << 2ull) ^ (hash<size_t>()(pe.filters.size()) << 3ull) ^
+                    (hash<int>()(static_cast<int>(pe.aggregate)) << 4ull) ^
+                    (hash<int>()(static_cast<int>(pe.order)) << 5ull) ^ (hash<size_t>()(pe.repeat) << 6ull);
+        }
+    };
+
+
+    template<>
+    struct hash<eventview::ViewDescriptor> {
+        std::size_t operator()(const eventview::ViewDescriptor &vd) const {
+            using std::size_t;
+            using std::hash;
+
+            auto h = hash<eventview::EntityDescriptor>()(vd.root) ^ hash<const eventview::ViewPlan *>()(vd.plan.get());
+            for (auto &path : vd.paths) {
+                for (auto &elem : path) {
+                    h = h * 31 + hash<eventview::PathElement>()(elem);
+                }
+                h = h * 31 + path.size();
+            }
+            if (vd.expectation) {
+                h = h * 31 + (hash<eventview::EntityDescriptor>()(vd.expectation->expected) ^
+                              hash<std::uint64_t>()(vd.expectation->minimum_write));
+            }
+            if (vd.lookup) {
+                using ValueVariant = decltype(vd.lookup->value.val);
+                h = h * 31 + (hash<std::string>()(vd.lookup->field) ^ hash<ValueVariant>()(vd.lookup->value.val));
+            }
+            if (vd.range) {
+                h = h * 31 + (hash<std::string>()(vd.range->field) ^ hash<size_t>()(vd.range->limit));
+            }
+            return h;
         }
     };
 }
@@ -4,16 +4,25 @@
 
 #include <optional>
 #include <variant>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
 
 #include "types.h"
 #include "opdispatch.h"
+#include "viewcache.h"
+#include "subscriptions.h"
 
 namespace eventview {
 
     template<std::uint32_t NumThreads>
     class ViewReader {
     public:
-        explicit ViewReader(std::shared_ptr<OpDispatch<NumThreads>> dispatch) : dispatch_{dispatch} {}
+        explicit ViewReader(std::shared_ptr<OpDispatch<NumThreads>> dispatch,
+                            std::shared_ptr<const ViewCache> cache = nullptr,
+                            std::shared_ptr<SubscriptionRegistry> subscriptions = nullptr,
+                            std::shared_ptr<ViewReaderImpl> impl = nullptr) :
+                dispatch_{dispatch}, cache_{cache}, subscriptions_{subscriptions}, impl_{impl} {}
 
         ViewReader(const ViewReader &) = delete;
 
@@ -27,8 +36,64 @@ namespace eventview {
 
         inline const std::optional<View> read_view(const ViewDescriptor &view_desc) const noexcept;
 
+        //waits up to the given time on the worker for the descriptor's expectation to be met
+        inline const std::optional<View> read_view(const ViewDescriptor &view_desc,
+                                                   std::chrono::milliseconds wait) const noexcept;
+
+        inline const std::vector<std::optional<View>> read_views(const std::vector<ViewDescriptor> &view_descs) const noexcept;
+
+        /*
+         * Streams the view's values to the visitor in chunks rather than returning a View. The visitor runs on the
+         * dispatch worker and must not block on this reader or a Publisher. Returns false if the root is missing.
+         */
+        inline bool stream_view(const ViewDescriptor &view_desc, std::size_t chunk_size,
+                                ChunkVisitor visitor) const noexcept;
+
+        inline std::optional<ColumnarView> read_columns(std::shared_ptr<const ViewPlan> plan,
+                                                        std::vector<EntityDescriptor> roots) const noexcept;
+
+        //one page of the descriptor's range scan, with its paths evaluated for every match
+        inline std::optional<ScanResult> scan_views(const ViewDescriptor &view_desc) const noexcept;
+
+        /*
+         * Evaluates the plan for every entity of the type that exists when the scan starts, calling the visitor
+         * concurrently from up to threads threads. Entities are read in batches, each one a task on the dispatch
+         * worker, and visited once the task is done, so publishes go on between batches. A publish waits at most
+         * for one batch of batch_size reads spread over the threads; a slow visitor never holds it up, but entities
+         * in different batches may be seen at different points in the log.
+         * Returns the number of views visited, or nothing if the scan failed.
+         */
+        inline std::optional<std::size_t> scan_type(EntityTypeID type, std::shared_ptr<const ViewPlan> plan,
+                                                    ScanVisitor visitor, std::size_t threads = 4,
+                                                    std::size_t batch_size = 256) const noexcept;
+
+        /*
+         * Calls back with the current view (EventID 0) and again with the triggering EventID after every publish
+         * that touches a node or reverse-ref field on the view's paths. Callbacks run on the dispatch worker and
+         * must not block on this reader or a Publisher.
+         */
+        inline std::optional<SubscriptionID> subscribe(const ViewDescriptor &view_desc, ViewCallback callback) const noexcept;
+
+        inline void unsubscribe(SubscriptionID id) const noexcept;
+
+        //empty when the system was built without a view cache
+        std::optional<CacheStats> cache_stats() const {
+            if (cache_) {
+                return cache_->stats();
+            }
+            return {};
+        }
+
+        //reads that shared the result of an identical queued read
+        std::uint64_t coalesced_reads() const {
+            return dispatch_->coalesced_reads();
+        }
+
     private:
         std::shared_ptr<OpDispatch<NumThreads>> dispatch_;
+        std::shared_ptr<const ViewCache> cache_;
+        std::shared_ptr<SubscriptionRegistry> subscriptions_;
+        std::shared_ptr<ViewReaderImpl> impl_;
     };
 
     template<std::uint32_t NumThreads>
@@ -45,6 +110,155 @@ namespace eventview {
         }
     }
 
+    template<std::uint32_t NumThreads>
+    inline const std::optional<View> ViewReader<NumThreads>::read_view(const ViewDescriptor &view_desc,
+                                                                       std::chrono::milliseconds wait) const noexcept {
+        try {
+            auto view_future = dispatch_->read_view(view_desc, wait);
+            return view_future.get();
+        } catch (...) {
+            return {};
+        }
+    }
+
+    template<std::uint32_t NumThreads>
+    inline const std::vector<std::optional<View>>
+    ViewReader<NumThreads>::read_views(const std::vector<ViewDescriptor> &view_descs) const noexcept {
+        try {
+            auto views_future = dispatch_->read_views(view_descs);
+            return views_future.get();
+        } catch (...) {
+            return std::vector<std::optional<View>>(view_descs.size());
+        }
+    }
+
+    template<std::uint32_t NumThreads>
+    inline std::optional<SubscriptionID> ViewReader<NumThreads>::subscribe(const ViewDescriptor &view_desc,
+                                                                           ViewCallback callback) const noexcept {
+        if (!subscriptions_) {
+            return {};
+        }
+
+        try {
+            auto id = subscriptions_->next_id();
+            auto registry = subscriptions_;
+            dispatch_->run_task([=]() {
+                registry->subscribe(id, view_desc, callback);
+            }).get();
+            return id;
+        } catch (...) {
+            return {};
+        }
+    }
+
+    template<std::uint32_t NumThreads>
+    inline void ViewReader<NumThreads>::unsubscribe(SubscriptionID id) const noexcept {
+        if (!subscriptions_) {
+            return;
+        }
+
+        try {
+            auto registry = subscriptions_;
+            dispatch_->run_task([=]() {
+                registry->unsubscribe(id);
+            }).get();
+        } catch (...) {
+        }
+    }
+
+    template<std::uint32_t NumThreads>
+    inline bool ViewReader<NumThreads>::stream_view(const ViewDescriptor &view_desc, std::size_t chunk_size,
+                                                    ChunkVisitor visitor) const noexcept {
+        if (!impl_) {
+            return false;
+        }
+
+        try {
+            auto impl = impl_;
+            bool found = false;
+            dispatch_->run_task([&, impl]() {
+                found = impl->stream_view(view_desc, chunk_size, visitor);
+            }).get();
+            return found;
+        } catch (...) {
+            return false;
+        }
+    }
+
+    template<std::uint32_t NumThreads>
+    inline std::optional<ColumnarView> ViewReader<NumThreads>::read_columns(std::shared_ptr<const ViewPlan> plan,
+                                                                            std::vector<EntityDescriptor> roots) const noexcept {
+        try {
+            auto columns_future = dispatch_->read_columns(ColumnRequest{std::move(plan), std::move(roots)});
+            return columns_future.get();
+        } catch (...) {
+            return {};
+        }
+    }
+
+    template<std::uint32_t NumThreads>
+    inline std::optional<std::size_t> ViewReader<NumThreads>::scan_type(EntityTypeID type,
+                                                                        std::shared_ptr<const ViewPlan> plan,
+                                                                        ScanVisitor visitor, std::size_t threads,
+                                                                        std::size_t batch_size) const noexcept {
+        if (!impl_ || !plan) {
+            return {};
+        }
+
+        try {
+            auto impl = impl_;
+            std::vector<EntityID> members{};
+            dispatch_->run_task([&, impl]() {
+                members = impl->type_members(type);
+            }).get();
+
+            std::atomic<std::size_t> visited{0};
+            ScanPool pool{std::min(threads, std::max<std::size_t>(1, members.size()))};
+            std::vector<std::optional<View>> views{};
+
+            batch_size = std::max<std::size_t>(1, batch_size);
+            for (std::size_t start = 0; start < members.size(); start += batch_size) {
+                auto begin = members.data() + start;
+                auto end = members.data() + std::min(members.size(), start + batch_size);
+                dispatch_->run_task([&, impl, begin, end]() {
+                    impl->scan_members(*plan, type, begin, end, pool, views);
+                }).get();
+
+                //visited off the worker, so only the reads hold up publishes
+                pool.run(views.size(), [&](std::size_t first, std::size_t last) {
+                    for (auto at = first; at < last; ++at) {
+                        if (views[at]) {
+                            visitor(*views[at]);
+                            visited.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                });
+            }
+
+            return visited.load();
+        } catch (...) {
+            return {};
+        }
+    }
+
+    template<std::uint32_t NumThreads>
+    inline std::optional<ScanResult> ViewReader<NumThreads>::scan_views(const ViewDescriptor &view_desc) const noexcept {
+        if (!impl_ || !view_desc.range) {
+            return {};
+        }
+
+        try {
+            auto impl = impl_;
+            ScanResult result{};
+            dispatch_->run_task([&, impl]() {
+                result = impl->scan_views(view_desc);
+            }).get();
+            return result;
+        } catch (...) {
+            return {};
+        }
+    }
+
 }
 
 #endif //EVENTVIEW_VIEW_H
@@ -0,0 +1,201 @@
+
+#ifndef EVENTVIEW_VIEWCACHE_H
+#define EVENTVIEW_VIEWCACHE_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "types.h"
+#include "viewplan.h"
+#include "dependencies.h"
+
+namespace eventview {
+
+    struct CacheStats {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t invalidations;
+    };
+
+    /*
+     * Caches finished views by descriptor. Entries are dropped when a publish touches any node or reverse-ref field
+     * recorded while the view was built, and the least recently used one makes room once the cache is full. Only
+     * the dispatch worker touches entries; stats may be read from any thread.
+     */
+    class ViewCache final {
+    public:
+        explicit ViewCache(std::size_t max_entries = 4096) : max_entries_{max_entries}, next_id_{0}, hits_{0},
+                                                             misses_{0}, invalidations_{0} {}
+
+        ViewCache(const ViewCache &) = delete;
+
+        ViewCache &operator=(const ViewCache &) = delete;
+
+        ~ViewCache() = default;
+
+        /*
+         * descriptors with an expectation depend on write times rather than values, and index lookups and scans on
+         * index contents the dependency tracking does not cover, so none of them are cached
+         */
+        static bool cacheable(const ViewDescriptor &view_desc) {
+            return !view_desc.expectation && !view_desc.lookup && !view_desc.range;
+        }
+
+        //hashed once per read and handed to both lookup and insert, which compare against the descriptor in place
+        static std::size_t key_hash(const ViewDescriptor &view_desc) {
+            auto h = std::hash<EntityDescriptor>()(view_desc.root) ^
+                     std::hash<const ViewPlan *>()(view_desc.plan.get());
+            return view_desc.plan ? h : h ^ ViewPathsHash()(view_desc.paths);
+        }
+
+        //the cached view shares its values with the entry, so a hit copies no values
+        inline const View *lookup(const ViewDescriptor &view_desc, std::size_t hash);
+
+        inline void insert(const ViewDescriptor &view_desc, std::size_t hash, const View &view,
+                           ReadDependencies deps);
+
+        inline void invalidate_node(const EntityDescriptor &node);
+
+        inline void invalidate_reverse_field(const EntityDescriptor &node, const std::string &field);
+
+        CacheStats stats() const {
+            return CacheStats{hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed),
+                              invalidations_.load(std::memory_order_relaxed)};
+        }
+
+        std::size_t size() const {
+            return entries_.size();
+        }
+
+    private:
+        struct Entry {
+            EntityDescriptor root;
+            std::shared_ptr<const ViewPlan> plan;
+            //only kept for descriptors without a plan, which the plan pointer identifies on its own
+            std::vector<ViewPath> paths;
+            std::size_t hash;
+            View view;
+            ReadDependencies deps;
+            std::list<std::uint64_t>::iterator recency;
+        };
+
+        static bool matches(const Entry &entry, const ViewDescriptor &view_desc) {
+            return entry.root == view_desc.root && entry.plan == view_desc.plan &&
+                   (entry.plan || entry.paths == view_desc.paths);
+        }
+
+        inline std::unordered_map<std::uint64_t, Entry>::iterator find(const ViewDescriptor &view_desc,
+                                                                       std::size_t hash);
+
+        inline void erase(std::uint64_t id);
+
+        void invalidate(const std::unordered_set<DependencyIndex::ID> *ids) {
+            if (!ids) {
+                return;
+            }
+
+            //erasing entries mutates the set being walked, so take a copy first
+            std::vector<std::uint64_t> affected{ids->begin(), ids->end()};
+            for (auto id : affected) {
+                erase(id);
+                invalidations_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        std::size_t max_entries_;
+        std::uint64_t next_id_;
+        //entry ids by key hash; descriptors whose hashes collide share a bucket and are told apart by matches
+        std::unordered_multimap<std::size_t, std::uint64_t> ids_;
+        std::unordered_map<std::uint64_t, Entry> entries_;
+        //entry ids, most recently used first
+        std::list<std::uint64_t> recency_;
+        DependencyIndex deps_;
+        std::atomic<std::uint64_t> hits_;
+        std::atomic<std::uint64_t> misses_;
+        std::atomic<std::uint64_t> invalidations_;
+    };
+
+    inline std::unordered_map<std::uint64_t, ViewCache::Entry>::iterator
+    ViewCache::find(const ViewDescriptor &view_desc, std::size_t hash) {
+        auto candidates = ids_.equal_range(hash);
+        for (auto candidate = candidates.first; candidate != candidates.second; ++candidate) {
+            auto found = entries_.find(candidate->second);
+            if (matches(found->second, view_desc)) {
+                return found;
+            }
+        }
+        return entries_.end();
+    }
+
+    inline const View *ViewCache::lookup(const ViewDescriptor &view_desc, std::size_t hash) {
+        auto found = find(view_desc, hash);
+        if (found == entries_.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        auto &entry = found->second;
+        recency_.splice(recency_.begin(), recency_, entry.recency);
+        return &entry.view;
+    }
+
+    inline void ViewCache::insert(const ViewDescriptor &view_desc, std::size_t hash, const View &view,
+                                  ReadDependencies deps) {
+        if (max_entries_ == 0) {
+            return;
+        }
+
+        auto existing = find(view_desc, hash);
+        if (existing != entries_.end()) {
+            erase(existing->first);
+        }
+
+        if (entries_.size() >= max_entries_) {
+            erase(recency_.back());
+        }
+
+        auto id = next_id_++;
+        deps_.add(id, deps);
+
+        recency_.push_front(id);
+        ids_.emplace(hash, id);
+        entries_.emplace(id, Entry{view_desc.root, view_desc.plan,
+                                   view_desc.plan ? std::vector<ViewPath>{} : view_desc.paths, hash, view,
+                                   std::move(deps), recency_.begin()});
+    }
+
+    inline void ViewCache::invalidate_node(const EntityDescriptor &node) {
+        invalidate(deps_.find_node(node));
+    }
+
+    inline void ViewCache::invalidate_reverse_field(const EntityDescriptor &node, const std::string &field) {
+        invalidate(deps_.find_reverse_field(node, field));
+    }
+
+    inline void ViewCache::erase(std::uint64_t id) {
+        auto found = entries_.find(id);
+        if (found == entries_.end()) {
+            return;
+        }
+
+        auto &entry = found->second;
+        deps_.remove(id, entry.deps);
+        auto candidates = ids_.equal_range(entry.hash);
+        for (auto candidate = candidates.first; candidate != candidates.second; ++candidate) {
+            if (candidate->second == id) {
+                ids_.erase(candidate);
+                break;
+            }
+        }
+        recency_.erase(entry.recency);
+        entries_.erase(found);
+    }
+
+}
+
+#endif //EVENTVIEW_VIEWCACHE_H
@@ -7,15 +7,304 @@
 
 #include <optional>
 #include <variant>
+#include <algorithm>
+#include <unordered_set>
+#include <thread>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 #include "types.h"
 #include "entitystorage.h"
+#include "viewplan.h"
+#include "viewcache.h"
+#include "fieldindex.h"
 
 namespace eventview {
 
+    /*
+     * Running reduction for one aggregated slot. Values are folded as the traversal reaches them, so an aggregated
+     * path never collects its values. Non numeric values only count towards Count.
+     */
+    struct Aggregator {
+        std::uint64_t count = 0;
+        std::uint64_t numeric = 0;
+        bool any_double = false;
+        std::uint64_t long_sum = 0;
+        std::double_t double_sum = 0;
+        std::optional<PrimitiveFieldValue> min{};
+        std::optional<PrimitiveFieldValue> max{};
+
+        static std::double_t to_double(const PrimitiveFieldValue &value) {
+            return value.is_long() ? static_cast<std::double_t>(value.as_long()) : value.as_double();
+        }
+
+        void add(const PrimitiveFieldValue &value) {
+            ++count;
+            if (!value.is_long() && !value.is_double()) {
+                return;
+            }
+
+            ++numeric;
+            if (value.is_long()) {
+                long_sum += value.as_long();
+            } else {
+                any_double = true;
+            }
+
+            auto as_double = to_double(value);
+            double_sum += as_double;
+            if (!min || as_double < to_double(*min)) {
+                min = value;
+            }
+            if (!max || as_double > to_double(*max)) {
+                max = value;
+            }
+        }
+
+        void add_entities(std::uint64_t entities) {
+            count += entities;
+        }
+
+        //Count is always present, the other reductions only once a numeric value was seen
+        std::optional<PrimitiveFieldValue> result(Aggregate aggregate) const {
+            switch (aggregate) {
+                case Aggregate::Count:
+                    return PrimitiveFieldValue{count};
+                case Aggregate::Sum:
+                    if (numeric == 0) {
+                        return {};
+                    }
+                    return any_double ? PrimitiveFieldValue{double_sum} : PrimitiveFieldValue{long_sum};
+                case Aggregate::Min:
+                    return min;
+                case Aggregate::Max:
+                    return max;
+                case Aggregate::Avg:
+                    if (numeric == 0) {
+                        return {};
+                    }
+                    return PrimitiveFieldValue{double_sum / numeric};
+                default:
+                    return {};
+            }
+        }
+    };
+
+    /*
+     * Per-query memo of store lookups. A read often resolves the same descriptor many times, for example every
+     * comment's author, so lookups go through a small open-addressed table that only falls through to EntityStore
+     * the first time a descriptor is seen. Missing entities are remembered too. Most reads never resolve more than
+     * one descriptor, so the first is kept inline and the table only allocated for a second. Node pointers stay
+     * valid because the store is not written while a read runs on the worker.
+     */
+    class LookupMemo final {
+    public:
+        explicit LookupMemo(std::size_t expected = 16) : first_{false, {}, nullptr}, expected_{expected}, size_{0},
+                                                         misses_{0} {}
+
+        const StorageNode *get(EntityStore &store, const EntityDescriptor &desc) {
+            if (slots_.empty()) {
+                if (!first_.used) {
+                    first_ = Slot{true, desc, find(store, desc)};
+                    return first_.node;
+                }
+                if (first_.desc == desc) {
+                    return first_.node;
+                }
+
+                slots_.resize(capacity_for(expected_));
+                slots_[probe(first_.desc)] = first_;
+                size_ = 1;
+            }
+
+            auto idx = probe(desc);
+            auto &slot = slots_[idx];
+            if (slot.used) {
+                return slot.node;
+            }
+
+            slot = Slot{true, desc, find(store, desc)};
+
+            auto node = slot.node;
+            if (++size_ * 2 > slots_.size()) {
+                grow();
+            }
+            return node;
+        }
+
+        //table slots allocated, none until a second descriptor is looked up
+        std::size_t capacity() const {
+            return slots_.size();
+        }
+
+        //lookups that had to go to the store
+        std::size_t misses() const {
+            return misses_;
+        }
+
+    private:
+        struct Slot {
+            bool used;
+            EntityDescriptor desc;
+            const StorageNode *node;
+        };
+
+        const StorageNode *find(EntityStore &store, const EntityDescriptor &desc) {
+            ++misses_;
+            const auto &found = store.get(desc);
+            return found ? &found->get() : nullptr;
+        }
+
+        static std::size_t capacity_for(std::size_t expected) {
+            std::size_t capacity = 16;
+            while (capacity < expected * 2) {
+                capacity <<= 1u;
+            }
+            return capacity;
+        }
+
+        std::size_t probe(const EntityDescriptor &desc) const {
+            auto mask = slots_.size() - 1;
+            //snowflake ids share their high bits, so mix before masking
+            auto idx = static_cast<std::size_t>((desc.id ^ static_cast<std::uint64_t>(desc.type)) *
+                                                0x9E3779B97F4A7C15ull >> 32u) & mask;
+            while (slots_[idx].used && !(slots_[idx].desc == desc)) {
+                idx = (idx + 1) & mask;
+            }
+            return idx;
+        }
+
+        void grow() {
+            std::vector<Slot> old(slots_.size() * 2);
+            old.swap(slots_);
+            for (auto &slot : old) {
+                if (slot.used) {
+                    slots_[probe(slot.desc)] = slot;
+                }
+            }
+        }
+
+        Slot first_;
+        std::size_t expected_;
+        std::vector<Slot> slots_;
+        std::size_t size_;
+        std::size_t misses_;
+    };
+
+    /*
+     * Threads kept for the length of a scan, so its batches don't each start their own. run splits [0, count)
+     * evenly between them and the calling thread, which takes the first part, and returns once every part is done,
+     * rethrowing the first exception any of them threw.
+     */
+    class ScanPool final {
+    public:
+        explicit ScanPool(std::size_t threads) : parts_{std::max<std::size_t>(1, threads)} {
+            try {
+                for (std::size_t part = 1; part < parts_; ++part) {
+                    helpers_.emplace_back([this, part]() { serve(part); });
+                }
+            } catch (...) {
+                //a thread that failed to start must not leave the started ones joinable, which would terminate
+                stop();
+                throw;
+            }
+        }
+
+        ScanPool(const ScanPool &) = delete;
+
+        ScanPool &operator=(const ScanPool &) = delete;
+
+        ~ScanPool() {
+            stop();
+        }
+
+        void run(std::size_t count, const std::function<void(std::size_t begin, std::size_t end)> &work) {
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                work_ = &work;
+                count_ = count;
+                failures_.assign(parts_, nullptr);
+                pending_ = helpers_.size();
+                ++generation_;
+            }
+            wake_.notify_all();
+
+            run_part(0);
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                done_.wait(lock, [this]() { return pending_ == 0; });
+                work_ = nullptr;
+            }
+
+            for (auto &failure : failures_) {
+                if (failure) {
+                    std::rethrow_exception(failure);
+                }
+            }
+        }
+
+    private:
+        void serve(std::size_t part) {
+            std::uint64_t seen = 0;
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock{mutex_};
+                    wake_.wait(lock, [&]() { return stopping_ || generation_ != seen; });
+                    if (stopping_) {
+                        return;
+                    }
+                    seen = generation_;
+                }
+
+                run_part(part);
+
+                std::lock_guard<std::mutex> lock{mutex_};
+                if (--pending_ == 0) {
+                    done_.notify_all();
+                }
+            }
+        }
+
+        void run_part(std::size_t part) {
+            try {
+                (*work_)(count_ * part / parts_, count_ * (part + 1) / parts_);
+            } catch (...) {
+                failures_[part] = std::current_exception();
+            }
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            for (auto &thread : helpers_) {
+                thread.join();
+            }
+            helpers_.clear();
+        }
+
+        std::size_t parts_;
+        std::vector<std::thread> helpers_{};
+        std::mutex mutex_{};
+        std::condition_variable wake_{};
+        std::condition_variable done_{};
+        const std::function<void(std::size_t, std::size_t)> *work_ = nullptr;
+        std::size_t count_ = 0;
+        std::vector<std::exception_ptr> failures_{};
+        std::size_t pending_ = 0;
+        std::uint64_t generation_ = 0;
+        bool stopping_ = false;
+    };
+
     class ViewReaderImpl {
     public:
-        explicit ViewReaderImpl(std::shared_ptr<EntityStore> store) : store_{std::move(store)} {}
+        explicit ViewReaderImpl(std::shared_ptr<EntityStore> store, std::shared_ptr<ViewCache> cache = nullptr,
+                                std::shared_ptr<const FieldIndexes> indexes = nullptr) :
+                store_{std::move(store)}, cache_{std::move(cache)}, indexes_{std::move(indexes)} {}
 
         ViewReaderImpl(const ViewReaderImpl &) = delete;
 
@@ -29,111 +318,757 @@ namespace eventview {
 
         inline const std::optional<View> read_view(const ViewDescriptor &view_desc) const;
 
+        //the descriptor's root, or the first entity its lookup or range currently resolves to through an index
+        inline std::optional<EntityDescriptor> resolve_root(const ViewDescriptor &view_desc) const;
+
+        //evaluates the descriptor's paths for every entity in one page of its range scan
+        inline ScanResult scan_views(const ViewDescriptor &view_desc) const;
+
+        /*
+         * The descriptor's prepared plan, or the plan compiled from its paths. Compiled plans are kept by paths, so
+         * an ad-hoc descriptor read over and over is only planned once; a malformed path is left out of the plan.
+         * Like the view cache, the compiled plans are only touched on the dispatch worker.
+         */
+        inline std::shared_ptr<const ViewPlan> plan_for(const ViewDescriptor &view_desc) const;
+
+        std::vector<EntityID> type_members(EntityTypeID type) const {
+            return store_->entities_of_type(type);
+        }
+
+        /*
+         * Evaluates the plan for each id in [begin, end) of the given type into views, one slot per id and empty for
+         * an id that no longer resolves, split across the pool's threads that only read the store. Must run while
+         * nothing writes to the store, i.e. as a task on the dispatch worker.
+         */
+        inline void scan_members(const ViewPlan &plan, EntityTypeID type, const EntityID *begin, const EntityID *end,
+                                 ScanPool &pool, std::vector<std::optional<View>> &views) const;
+
+        inline const std::optional<View> read_view(const ViewPlan &plan, const EntityDescriptor &root,
+                                                   const std::optional<ExpectedEntity> &expectation,
+                                                   ReadDependencies *deps = nullptr) const;
+
+        inline ColumnarView read_columns(const ViewPlan &plan, const std::vector<EntityDescriptor> &roots) const;
+
+        /*
+         * Hands values to the visitor in chunks of at most chunk_size per path instead of building a View, so memory
+         * stays bounded for large fan-outs. Expectations are not checked. Returns false when the root does not exist.
+         */
+        inline bool stream_view(const ViewDescriptor &view_desc, std::size_t chunk_size,
+                                const ChunkVisitor &visitor) const;
+
     private:
 
-        inline void process_path_element(const ViewPath &path, const ViewPath::size_type &idx,
-                                         const StorageNode &node, ViewBuilder &builder) const;
+        //per-read state threaded through a traversal
+        struct ReadContext {
+            ViewBuilder builder;
+            ReadDependencies *deps;
+            const ChunkVisitor *stream = nullptr;
+            std::size_t chunk_size = 0;
+            std::vector<std::vector<PrimitiveFieldValue>> chunks{};
+            //by slot, only sized when the plan has aggregated paths
+            std::vector<Aggregator> aggregates{};
+            LookupMemo memo{};
+        };
+
+        /*
+         * A reverse ref whose only continuation is an entity count can be answered from the node's live degree
+         * without visiting a single referencer.
+         */
+        static bool counts_by_degree(const ViewPlan &plan, const PlanNode &plan_node) {
+            auto &step = plan_node.step;
+            if (step.limit > 0 || step.after > 0 || step.filters != 0 || step.repeat > 0 ||
+                plan_node.children.size() != 1) {
+                return false;
+            }
+
+            auto &leaf = plan.nodes()[plan_node.children.front()].step;
+            return leaf.counts_entities(plan.name(leaf)) && leaf.filters == 0;
+        }
+
+        inline void fold(const ViewPlan &plan, const PlanStep &step, const StorageNode &node,
+                         Aggregator &aggregator) const;
+
+        inline void emit_aggregates(const ViewPlan &plan, ReadContext &ctx) const;
+
+        /*
+         * Visits the stored referencers a reverse-ref step selects in the step's order, dropping those its filters
+         * reject, and honours its limit over the ones that pass. Returns the id to resume after when an id ordered
+         * page stopped at its limit with matching referencers left over.
+         */
+        template<typename Visitor>
+        std::optional<EntityID> visit_fan_out(const ViewPlan &plan, const PlanStep &step, const StorageNode &node,
+                                              ReadDependencies *deps, LookupMemo &memo, Visitor &&visitor) const {
+            std::size_t taken = 0;
+            EntityID last = 0;
+            bool more = false;
+
+            auto resolve = [&](const EntityDescriptor &ed) -> const StorageNode * {
+                if (ed.type != step.type) {
+                    return nullptr;
+                }
+                if (deps) {
+                    //a rejected referencer can start matching on a later write
+                    deps->nodes.push_back(ed);
+                }
+
+                auto next_node = memo.get(*store_, ed);
+                if (!next_node || !plan.passes(step, next_node->get_fields())) {
+                    return nullptr;
+                }
+                return next_node;
+            };
+
+            auto take = [&](const EntityDescriptor &ed) {
+                auto next_node = resolve(ed);
+                if (!next_node) {
+                    return true;
+                }
+                if (step.limit > 0 && taken == step.limit) {
+                    more = true;
+                    return false;
+                }
+
+                ++taken;
+                last = ed.id;
+                visitor(*next_node);
+                return true;
+            };
+
+            switch (step.order) {
+                case RefOrder::None:
+                    node.visit_referencers(plan.name(step), step.after, take);
+                    break;
+                case RefOrder::Newest:
+                case RefOrder::Oldest:
+                    node.visit_referencers_by_time(plan.name(step), step.order == RefOrder::Newest, take);
+                    break;
+                case RefOrder::Highest:
+                case RefOrder::Lowest:
+                    visit_ranked(plan, step, node, resolve, visitor);
+                    break;
+            }
+
+            if (more && step.order == RefOrder::None) {
+                return last;
+            }
+            return {};
+        }
+
+        /*
+         * Keeps the best limit referencers by the step's order_by field in a bounded heap, so ranking N referencers
+         * costs O(N log K) with only K of them held, then visits them best first. Referencers without a numeric
+         * order_by value are skipped.
+         */
+        template<typename Resolve, typename Visitor>
+        void visit_ranked(const ViewPlan &plan, const PlanStep &step, const StorageNode &node, Resolve &resolve,
+                          Visitor &visitor) const {
+            struct Ranked {
+                std::double_t key;
+                EntityID id;
+                const StorageNode *node;
+            };
+
+            auto highest = step.order == RefOrder::Highest;
+            auto better = [highest](const Ranked &lhs, const Ranked &rhs) {
+                if (lhs.key != rhs.key) {
+                    return highest ? lhs.key > rhs.key : lhs.key < rhs.key;
+                }
+                return lhs.id < rhs.id;
+            };
+
+            auto &order_by = plan.order_by(step);
+            std::vector<Ranked> heap{};
+
+            node.visit_referencers(plan.name(step), 0, [&](const EntityDescriptor &ed) {
+                auto next_node = resolve(ed);
+                if (!next_node) {
+                    return true;
+                }
+
+                auto &fields = next_node->get_fields();
+                auto found = fields.find(order_by);
+                if (found == fields.end() || !(found->second.is_long() || found->second.is_double())) {
+                    return true;
+                }
+
+                //ordered by better, so the front of the heap is the worst referencer kept so far
+                Ranked ranked{Aggregator::to_double(found->second), ed.id, next_node};
+                if (step.limit == 0 || heap.size() < step.limit) {
+                    heap.push_back(ranked);
+                    std::push_heap(heap.begin(), heap.end(), better);
+                } else if (better(ranked, heap.front())) {
+                    std::pop_heap(heap.begin(), heap.end(), better);
+                    heap.back() = ranked;
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+                return true;
+            });
+
+            std::sort_heap(heap.begin(), heap.end(), better);
+            for (auto &ranked : heap) {
+                visitor(*ranked.node);
+            }
+        }
+
+        /*
+         * Visits the entities a single ref or reverse-ref step reaches from node, after its filters and page.
+         * Returns the resume cursor of a paged reverse ref.
+         */
+        template<typename Visitor>
+        std::optional<EntityID> hop(const ViewPlan &plan, const PlanStep &step, const StorageNode &node,
+                                    ReadDependencies *deps, LookupMemo &memo, Visitor &&visitor) const {
+            if (step.kind == StepKind::ReverseRef) {
+                if (deps) {
+                    deps->reverse_fields.emplace_back(node.descriptor(), plan.name(step));
+                }
+                return visit_fan_out(plan, step, node, deps, memo, visitor);
+            }
+
+            auto &fields = node.get_fields();
+            auto ref = fields.find(plan.name(step));
+            if (ref != fields.end() && ref->second.is_descriptor() && ref->second.as_descriptor().type == step.type) {
+                auto &desc = ref->second.as_descriptor();
+                if (deps) {
+                    //recorded before the lookup so a target that appears later still invalidates
+                    deps->nodes.push_back(desc);
+                }
+
+                auto next_node = memo.get(*store_, desc);
+                if (next_node && plan.passes(step, next_node->get_fields())) {
+                    visitor(*next_node);
+                }
+            }
+            return {};
+        }
+
+        /*
+         * Follows a repeated step breadth first from start, at most step.repeat hops deep. Each entity is reached
+         * at most once, so cycles in the graph end the walk rather than looping, and the visitor sees entities in
+         * level order.
+         */
+        template<typename Visitor>
+        void visit_closure(const ViewPlan &plan, const PlanStep &step, const StorageNode &start,
+                           ReadDependencies *deps, LookupMemo &memo, Visitor &&visitor) const {
+            std::unordered_set<EntityID> visited{start.descriptor().id};
+            std::vector<const StorageNode *> level{&start};
+            std::vector<const StorageNode *> next{};
+
+            for (std::size_t depth = 0; depth < step.repeat && !level.empty(); ++depth) {
+                next.clear();
+                for (auto from : level) {
+                    hop(plan, step, *from, deps, memo, [&](const StorageNode &reached) {
+                        if (visited.insert(reached.descriptor().id).second) {
+                            next.push_back(&reached);
+                        }
+                    });
+                }
+
+                for (auto reached : next) {
+                    visitor(*reached);
+                }
+                level.swap(next);
+            }
+        }
+
+        inline void emit(ReadContext &ctx, std::uint32_t slot, const PrimitiveFieldValue &value) const;
+
+        inline void flush(ReadContext &ctx, std::uint32_t slot) const;
+
+        struct Row {
+            std::uint32_t row;
+            const StorageNode *node;
+        };
+
+        struct RowValue {
+            std::uint32_t row;
+            PrimitiveFieldValue value;
+        };
+
+        inline void process_columns(const ViewPlan &plan, const std::vector<std::size_t> &children,
+                                    const std::vector<Row> &frontier, std::vector<std::vector<RowValue>> &gathered,
+                                    std::vector<std::vector<Aggregator>> &aggregates, LookupMemo &memo) const;
+
+        inline static Column to_column(std::vector<RowValue> &gathered, std::size_t rows);
 
-        inline void follow_ref(const ViewPath &path, const PathElement &elem, const ViewPath::size_type &idx,
-                               const StorageNode &node, ViewBuilder &builder) const;
+        inline void resolve_frontier(const std::vector<std::pair<std::uint32_t, EntityDescriptor>> &targets,
+                                     std::vector<Row> &next, LookupMemo &memo) const;
 
-        inline void follow_reverse_refs(const ViewPath &path, const PathElement &elem, const ViewPath::size_type &idx,
-                                        const StorageNode &node, ViewBuilder &builder) const;
+        inline void process_children(const ViewPlan &plan, const std::vector<std::size_t> &children,
+                                     const StorageNode &node, ReadContext &ctx) const;
 
-        inline void load_value(const ViewPath &path, const PathElement &path_elem,
-                               const StorageNode &node, ViewBuilder &builder) const;
+        inline void follow_ref(const ViewPlan &plan, const PlanNode &plan_node,
+                               const StorageNode &node, ReadContext &ctx) const;
+
+        inline void follow_reverse_refs(const ViewPlan &plan, const PlanNode &plan_node,
+                                        const StorageNode &node, ReadContext &ctx) const;
+
+        inline void load_value(const ViewPlan &plan, const PlanNode &plan_node,
+                               const StorageNode &node, ReadContext &ctx) const;
+
+        //ad-hoc descriptors are meant to be few and read often, so the plans are dropped wholesale past this
+        static constexpr std::size_t MAX_AD_HOC_PLANS = 1024;
 
         std::shared_ptr<EntityStore> store_;
+        std::shared_ptr<ViewCache> cache_;
+        std::shared_ptr<const FieldIndexes> indexes_;
+        mutable std::unordered_map<std::vector<ViewPath>, std::shared_ptr<const ViewPlan>, ViewPathsHash> plans_{};
     };
 
+    inline std::shared_ptr<const ViewPlan> ViewReaderImpl::plan_for(const ViewDescriptor &view_desc) const {
+        if (view_desc.plan) {
+            return view_desc.plan;
+        }
+
+        auto found = plans_.find(view_desc.paths);
+        if (found != plans_.end()) {
+            return found->second;
+        }
+
+        auto plan = make_lenient_view_plan(view_desc.paths);
+        if (plans_.size() >= MAX_AD_HOC_PLANS) {
+            plans_.clear();
+        }
+        plans_.emplace(view_desc.paths, plan);
+        return plan;
+    }
+
     inline const std::optional<View> ViewReaderImpl::read_view(const ViewDescriptor &view_desc) const {
-        const auto &root_node = store_->get(view_desc.root);
+        ReadDependencies deps{};
+        auto use_cache = cache_ && ViewCache::cacheable(view_desc);
+        auto hash = use_cache ? ViewCache::key_hash(view_desc) : 0;
 
-        if (root_node) {
-            ViewBuilder builder{view_desc.root, view_desc.expectation};
+        if (use_cache) {
+            auto cached = cache_->lookup(view_desc, hash);
+            if (cached) {
+                return *cached;
+            }
+        }
+
+        auto root = resolve_root(view_desc);
+        if (!root) {
+            return {};
+        }
+
+        auto view = read_view(*plan_for(view_desc), *root, view_desc.expectation, use_cache ? &deps : nullptr);
+
+        if (use_cache && view) {
+            cache_->insert(view_desc, hash, *view, std::move(deps));
+        }
+
+        return view;
+    }
+
+    inline std::optional<EntityDescriptor> ViewReaderImpl::resolve_root(const ViewDescriptor &view_desc) const {
+        if (!view_desc.lookup && !view_desc.range) {
+            return view_desc.root;
+        }
+        if (!indexes_) {
+            return {};
+        }
+        if (view_desc.lookup) {
+            return indexes_->resolve(*view_desc.lookup);
+        }
+
+        std::optional<EntityDescriptor> first{};
+        auto range = *view_desc.range;
+        range.limit = 1;
+        indexes_->scan(range, [&](EntityID id) {
+            first = EntityDescriptor{id, range.type};
+        });
+        return first;
+    }
+
+    inline ScanResult ViewReaderImpl::scan_views(const ViewDescriptor &view_desc) const {
+        ScanResult result{};
+        if (!view_desc.range || !indexes_) {
+            return result;
+        }
+
+        auto compiled = plan_for(view_desc);
+        auto type = view_desc.range->type;
+
+        result.next = indexes_->scan(*view_desc.range, [&](EntityID id) {
+            auto view = read_view(*compiled, EntityDescriptor{id, type}, view_desc.expectation);
+            if (view) {
+                result.views.push_back(std::move(*view));
+            }
+        });
+
+        return result;
+    }
+
+    inline void ViewReaderImpl::scan_members(const ViewPlan &plan, EntityTypeID type, const EntityID *begin,
+                                             const EntityID *end, ScanPool &pool,
+                                             std::vector<std::optional<View>> &views) const {
+        views.clear();
+        views.resize(static_cast<std::size_t>(end - begin));
+        pool.run(views.size(), [&](std::size_t first, std::size_t last) {
+            for (auto at = first; at < last; ++at) {
+                views[at] = read_view(plan, EntityDescriptor{begin[at], type}, {});
+            }
+        });
+    }
 
-            for (auto &path : view_desc.paths) {
-                process_path_element(path, 0, root_node->get(), builder);
+    inline const std::optional<View> ViewReaderImpl::read_view(const ViewPlan &plan, const EntityDescriptor &root,
+                                                               const std::optional<ExpectedEntity> &expectation,
+                                                               ReadDependencies *deps) const {
+        if (deps) {
+            //a root that does not exist yet still matters to whoever is waiting on it
+            deps->nodes.push_back(root);
+        }
+
+        const auto &root_node = store_->get(root);
+
+        if (root_node) {
+            ReadContext ctx{ViewBuilder{root, expectation, plan.index()}, deps};
+            if (plan.has_aggregates()) {
+                ctx.aggregates.resize(plan.index()->size());
             }
 
-            return builder.finish();
+            process_children(plan, plan.roots(), root_node->get(), ctx);
+            emit_aggregates(plan, ctx);
+
+            return ctx.builder.finish();
         }
 
         return {};
+    }
+
+
+    inline bool ViewReaderImpl::stream_view(const ViewDescriptor &view_desc, std::size_t chunk_size,
+                                            const ChunkVisitor &visitor) const {
+        auto compiled = plan_for(view_desc);
+        auto &plan = *compiled;
+
+        auto root = resolve_root(view_desc);
+        if (!root) {
+            return false;
+        }
+
+        const auto &root_node = store_->get(*root);
+        if (!root_node) {
+            return false;
+        }
+
+        ReadContext ctx{ViewBuilder{*root, {}, plan.index()}, nullptr};
+        ctx.stream = &visitor;
+        ctx.chunk_size = chunk_size > 0 ? chunk_size : 1;
+        ctx.chunks.resize(plan.index()->size());
+        if (plan.has_aggregates()) {
+            ctx.aggregates.resize(plan.index()->size());
+        }
 
+        process_children(plan, plan.roots(), root_node->get(), ctx);
+        emit_aggregates(plan, ctx);
+
+        for (std::uint32_t slot = 0; slot < ctx.chunks.size(); ++slot) {
+            flush(ctx, slot);
+        }
+
+        return true;
     }
 
+    inline ColumnarView ViewReaderImpl::read_columns(const ViewPlan &plan,
+                                                     const std::vector<EntityDescriptor> &roots) const {
+        std::vector<std::pair<std::uint32_t, EntityDescriptor>> targets{};
+        targets.reserve(roots.size());
+        for (std::uint32_t i = 0; i < roots.size(); ++i) {
+            targets.emplace_back(i, roots[i]);
+        }
+
+        LookupMemo memo{roots.size()};
+        std::vector<Row> frontier{};
+        resolve_frontier(targets, frontier, memo);
+
+        std::vector<bool> found(roots.size(), false);
+        for (auto &row : frontier) {
+            found[row.row] = true;
+        }
 
-    inline void
-    ViewReaderImpl::process_path_element(const ViewPath &path, const ViewPath::size_type &idx, const StorageNode &node,
-                                     ViewBuilder &builder) const {
-        if (idx < path.size()) {
+        std::vector<std::vector<RowValue>> gathered(plan.index()->size());
+        std::vector<std::vector<Aggregator>> aggregates(gathered.size());
+        for (std::uint32_t slot = 0; slot < gathered.size(); ++slot) {
+            if (plan.aggregate(slot) != Aggregate::None) {
+                aggregates[slot].resize(roots.size());
+            }
+        }
 
-            if (!builder.expectation_met()) {
-                auto &expected = builder.expectation();
-                if (expected) {
-                    auto met = (expected->expected == node.descriptor()) &&
-                               (node.max_write_time() >= expected->minimum_write);
-                    builder.expectation_result(met);
+        process_columns(plan, plan.roots(), frontier, gathered, aggregates, memo);
+
+        std::vector<Column> columns{};
+        columns.reserve(gathered.size());
+        for (std::uint32_t slot = 0; slot < gathered.size(); ++slot) {
+            for (std::uint32_t row = 0; row < aggregates[slot].size(); ++row) {
+                auto result = found[row] ? aggregates[slot][row].result(plan.aggregate(slot)) : std::nullopt;
+                if (result) {
+                    gathered[slot].push_back(RowValue{row, std::move(*result)});
                 }
             }
+            columns.push_back(to_column(gathered[slot], roots.size()));
+        }
+
+        return ColumnarView{roots, std::move(found), plan.index(), std::move(columns)};
+    }
 
-            auto &elem = path[idx];
+    /*
+     * A slot shared by several plan nodes is filled by one pass over the frontier per node, so its values are not
+     * in row order; they are scattered back into it, keeping the order each row's values arrived in.
+     */
+    inline Column ViewReaderImpl::to_column(std::vector<RowValue> &gathered, std::size_t rows) {
+        Column col{};
+        col.offsets.assign(rows + 1, 0);
+        for (auto &value : gathered) {
+            ++col.offsets[value.row + 1];
+        }
+        for (std::size_t i = 1; i < col.offsets.size(); ++i) {
+            col.offsets[i] += col.offsets[i - 1];
+        }
+
+        auto cursor = col.offsets;
+        col.values.resize(gathered.size());
+        for (auto &value : gathered) {
+            col.values[cursor[value.row]++] = std::move(value.value);
+        }
+        return col;
+    }
 
-            if (elem.is_val()) {
-                load_value(path, elem, node, builder);
-            } else if (elem.is_ref()) {
-                follow_ref(path, elem, idx, node, builder);
-            } else if (elem.is_reverse_ref()) {
-                follow_reverse_refs(path, elem, idx, node, builder);
+    inline void ViewReaderImpl::resolve_frontier(const std::vector<std::pair<std::uint32_t, EntityDescriptor>> &targets,
+                                                 std::vector<Row> &next, LookupMemo &memo) const {
+        next.reserve(next.size() + targets.size());
+
+        for (auto &target : targets) {
+            auto node = memo.get(*store_, target.second);
+            if (node) {
+                next.push_back(Row{target.first, node});
             }
         }
     }
 
+    inline void ViewReaderImpl::process_columns(const ViewPlan &plan, const std::vector<std::size_t> &children,
+                                                const std::vector<Row> &frontier,
+                                                std::vector<std::vector<RowValue>> &gathered,
+                                                std::vector<std::vector<Aggregator>> &aggregates,
+                                                LookupMemo &memo) const {
+        std::vector<std::pair<std::uint32_t, EntityDescriptor>> targets{};
+        std::vector<Row> next{};
 
-    inline void ViewReaderImpl::follow_ref(const ViewPath &path, const PathElement &elem, const ViewPath::size_type &idx,
-                                       const StorageNode &node, ViewBuilder &builder) const {
+        for (auto idx : children) {
+            auto &plan_node = plan.nodes()[idx];
+            auto &name = plan.name(plan_node.step);
 
-        auto &fields = node.get_fields();
-        auto ref = fields.find(elem.name);
+            if (plan_node.step.kind == StepKind::Value && plan_node.step.aggregate != Aggregate::None) {
+                auto &by_row = aggregates[plan.paths()[plan_node.path].slot];
+                for (auto &row : frontier) {
+                    fold(plan, plan_node.step, *row.node, by_row[row.row]);
+                }
+                continue;
+            }
 
-        if (ref != fields.end()) {
-            if (ref->second.is_descriptor()) {
-                auto &desc = ref->second.as_descriptor();
+            if (plan_node.step.kind == StepKind::ReverseRef && counts_by_degree(plan, plan_node)) {
+                auto &leaf = plan.nodes()[plan_node.children.front()];
+                auto &by_row = aggregates[plan.paths()[leaf.path].slot];
+                for (auto &row : frontier) {
+                    by_row[row.row].add_entities(row.node->referencer_count(name, plan_node.step.type));
+                }
+                continue;
+            }
+
+            if (plan_node.step.kind == StepKind::Value) {
+                auto &values = gathered[plan.paths()[plan_node.path].slot];
+
+                for (auto &row : frontier) {
+                    auto &fields = row.node->get_fields();
+                    auto field_val = fields.find(name);
+                    if (field_val != fields.end() && plan.passes(plan_node.step, fields)) {
+                        values.push_back(RowValue{row.row, field_val->second});
+                    }
+                }
+                continue;
+            }
+
+            targets.clear();
+            next.clear();
 
-                if (desc.type == elem.type) {
-                    const auto &next_node = store_->get(desc);
-                    if (next_node) {
-                        process_path_element(path, idx + 1, next_node->get(), builder);
+            if (plan_node.step.repeat > 0) {
+                //each closure stays with the row it started from, so next is still in row order
+                for (auto &row : frontier) {
+                    visit_closure(plan, plan_node.step, *row.node, nullptr, memo, [&](const StorageNode &reached) {
+                        next.push_back(Row{row.row, &reached});
+                    });
+                }
+            } else if (plan_node.step.kind == StepKind::Ref) {
+                for (auto &row : frontier) {
+                    auto &fields = row.node->get_fields();
+                    auto ref = fields.find(name);
+                    if (ref != fields.end() && ref->second.is_descriptor() &&
+                        ref->second.as_descriptor().type == plan_node.step.type) {
+                        targets.emplace_back(row.row, ref->second.as_descriptor());
                     }
                 }
+
+                resolve_frontier(targets, next, memo);
+                next.erase(std::remove_if(next.begin(), next.end(), [&](const Row &row) {
+                    return !plan.passes(plan_node.step, row.node->get_fields());
+                }), next.end());
+            } else {
+                //the fan-out already resolved and filtered each referencer
+                for (auto &row : frontier) {
+                    visit_fan_out(plan, plan_node.step, *row.node, nullptr, memo, [&](const StorageNode &target) {
+                        next.push_back(Row{row.row, &target});
+                    });
+                }
+            }
+
+            if (!next.empty()) {
+                process_columns(plan, plan_node.children, next, gathered, aggregates, memo);
             }
         }
     }
 
 
-    inline void
-    ViewReaderImpl::follow_reverse_refs(const ViewPath &path, const PathElement &elem, const ViewPath::size_type &idx,
-                                    const StorageNode &node, ViewBuilder &builder) const {
+    inline void ViewReaderImpl::process_children(const ViewPlan &plan, const std::vector<std::size_t> &children,
+                                                 const StorageNode &node, ReadContext &ctx) const {
+        if (children.empty()) {
+            return;
+        }
 
-        for (auto &ed : node.referencers_for_field(elem.name)) {
-            if (ed.type == elem.type) {
-                const auto &next_node = store_->get(ed);
-                if (next_node) {
-                    process_path_element(path, idx + 1, next_node->get(), builder);
-                }
+        if (ctx.deps) {
+            ctx.deps->nodes.push_back(node.descriptor());
+        }
+
+        if (!ctx.builder.expectation_met()) {
+            auto &expected = ctx.builder.expectation();
+            if (expected) {
+                auto met = (expected->expected == node.descriptor()) &&
+                           (node.max_write_time() >= expected->minimum_write);
+                ctx.builder.expectation_result(met);
+            }
+        }
+
+        for (auto idx : children) {
+            auto &plan_node = plan.nodes()[idx];
+
+            if (plan_node.step.repeat > 0) {
+                visit_closure(plan, plan_node.step, node, ctx.deps, ctx.memo, [&](const StorageNode &reached) {
+                    process_children(plan, plan_node.children, reached, ctx);
+                });
+                continue;
+            }
+
+            switch (plan_node.step.kind) {
+                case StepKind::Value:
+                    load_value(plan, plan_node, node, ctx);
+                    break;
+                case StepKind::Ref:
+                    follow_ref(plan, plan_node, node, ctx);
+                    break;
+                case StepKind::ReverseRef:
+                    follow_reverse_refs(plan, plan_node, node, ctx);
+                    break;
+            }
+        }
+    }
+
+
+    inline void ViewReaderImpl::follow_ref(const ViewPlan &plan, const PlanNode &plan_node,
+                                           const StorageNode &node, ReadContext &ctx) const {
+        hop(plan, plan_node.step, node, ctx.deps, ctx.memo, [&](const StorageNode &next_node) {
+            process_children(plan, plan_node.children, next_node, ctx);
+        });
+    }
+
+
+    inline void ViewReaderImpl::follow_reverse_refs(const ViewPlan &plan, const PlanNode &plan_node,
+                                                    const StorageNode &node, ReadContext &ctx) const {
+        //skipping the referencers is only safe once they can no longer be needed to meet the expectation
+        if (counts_by_degree(plan, plan_node) && ctx.builder.expectation_met()) {
+            if (ctx.deps) {
+                ctx.deps->reverse_fields.emplace_back(node.descriptor(), plan.name(plan_node.step));
+            }
+
+            auto &leaf = plan.nodes()[plan_node.children.front()];
+            ctx.aggregates[plan.paths()[leaf.path].slot].add_entities(
+                    node.referencer_count(plan.name(plan_node.step), plan_node.step.type));
+            return;
+        }
+
+        auto cursor = hop(plan, plan_node.step, node, ctx.deps, ctx.memo, [&](const StorageNode &next_node) {
+            process_children(plan, plan_node.children, next_node, ctx);
+        });
+
+        if (cursor) {
+            for (auto slot : plan_node.slots) {
+                ctx.builder.set_cursor(slot, *cursor);
             }
         }
     }
 
 
-    inline void ViewReaderImpl::load_value(const ViewPath &path, const PathElement &path_elem, const StorageNode &node,
-                                       ViewBuilder &builder) const {
+    inline void ViewReaderImpl::load_value(const ViewPlan &plan, const PlanNode &plan_node,
+                                           const StorageNode &node, ReadContext &ctx) const {
+        if (plan_node.step.aggregate != Aggregate::None) {
+            fold(plan, plan_node.step, node, ctx.aggregates[plan.paths()[plan_node.path].slot]);
+            return;
+        }
+
+        auto &fields = node.get_fields();
+        auto field_val = fields.find(plan.name(plan_node.step));
+
+        if (field_val != fields.end() && plan.passes(plan_node.step, fields)) {
+            emit(ctx, plan.paths()[plan_node.path].slot, field_val->second);
+        }
+    }
+
+
+    inline void ViewReaderImpl::fold(const ViewPlan &plan, const PlanStep &step, const StorageNode &node,
+                                     Aggregator &aggregator) const {
         auto &fields = node.get_fields();
-        auto field_val = fields.find(path_elem.name);
+        if (!plan.passes(step, fields)) {
+            return;
+        }
+
+        auto &name = plan.name(step);
+        if (step.counts_entities(name)) {
+            aggregator.add_entities(1);
+            return;
+        }
 
+        auto field_val = fields.find(name);
         if (field_val != fields.end()) {
-            builder.add_path_val(path, field_val->second);
+            aggregator.add(field_val->second);
+        }
+    }
+
+
+    inline void ViewReaderImpl::emit_aggregates(const ViewPlan &plan, ReadContext &ctx) const {
+        for (std::uint32_t slot = 0; slot < ctx.aggregates.size(); ++slot) {
+            auto result = ctx.aggregates[slot].result(plan.aggregate(slot));
+            if (result) {
+                emit(ctx, slot, *result);
+            }
+        }
+    }
+
+
+    inline void ViewReaderImpl::emit(ReadContext &ctx, std::uint32_t slot, const PrimitiveFieldValue &value) const {
+        if (!ctx.stream) {
+            ctx.builder.add_slot_val(slot, value);
+            return;
+        }
+
+        auto &chunk = ctx.chunks[slot];
+        chunk.push_back(value);
+        if (chunk.size() >= ctx.chunk_size) {
+            flush(ctx, slot);
+        }
+    }
+
+
+    inline void ViewReaderImpl::flush(ReadContext &ctx, std::uint32_t slot) const {
+        auto &chunk = ctx.chunks[slot];
+        if (!chunk.empty()) {
+            (*ctx.stream)(PathHandle{slot}, ValueSpan{chunk.data(), chunk.data() + chunk.size()});
+            chunk.clear();
         }
     }
 }
@@ -0,0 +1,338 @@
+
+#ifndef EVENTVIEW_VIEWPLAN_H
+#define EVENTVIEW_VIEWPLAN_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+
+#include "types.h"
+
+namespace eventview {
+
+    enum class StepKind {
+        Value,
+        Ref,
+        ReverseRef
+    };
+
+    struct PlanStep {
+        std::uint32_t name;
+        EntityTypeID type;
+        StepKind kind;
+        std::size_t limit;
+        EntityID after;
+        //interned filter set, 0 when the step has none
+        std::uint32_t filters;
+        Aggregate aggregate;
+        RefOrder order;
+        //interned name of the field Highest and Lowest rank by
+        std::uint32_t order_by;
+        std::size_t repeat;
+
+        bool same_hop(const PlanStep &other) const {
+            return name == other.name && type == other.type && kind == other.kind && limit == other.limit &&
+                   after == other.after && filters == other.filters && aggregate == other.aggregate &&
+                   order == other.order && order_by == other.order_by && repeat == other.repeat;
+        }
+
+        //a count of the entities reached by the previous step rather than of a field's values
+        bool counts_entities(const std::string &step_name) const {
+            return aggregate == Aggregate::Count && step_name.empty();
+        }
+    };
+
+    struct PlanPath {
+        std::vector<PlanStep> steps;
+        std::string key;
+        std::uint32_t slot;
+    };
+
+    /*
+     * Paths in a plan are merged into a prefix trie. Each hop shared by several paths is a single node, so
+     * execution resolves it once and evaluates every sub-path at the entity it reaches. Value nodes are leaves
+     * and record which path they complete.
+     */
+    struct PlanNode {
+        PlanStep step;
+        std::vector<std::size_t> children;
+        std::size_t path;
+        //slots of every path that passes through this node
+        std::vector<std::uint32_t> slots;
+    };
+
+    /*
+     * A ViewPlan is the prepared form of the paths in a ViewDescriptor. Field names are interned, result keys are
+     * built and paths are validated once, so the plan can be executed against any number of roots without redoing
+     * that work per read.
+     */
+    class ViewPlan final {
+    public:
+        explicit ViewPlan(const std::vector<ViewPath> &paths);
+
+        ViewPlan(const ViewPlan &) = default;
+
+        ViewPlan &operator=(const ViewPlan &) = default;
+
+        ViewPlan(ViewPlan &&) = default;
+
+        ViewPlan &operator=(ViewPlan &&) = default;
+
+        ~ViewPlan() = default;
+
+        const std::vector<PlanPath> &paths() const {
+            return paths_;
+        }
+
+        const std::vector<PlanNode> &nodes() const {
+            return nodes_;
+        }
+
+        //children of the implicit root node, evaluated at the root entity
+        const std::vector<std::size_t> &roots() const {
+            return roots_;
+        }
+
+        const std::string &name(const PlanStep &step) const {
+            return names_[step.name];
+        }
+
+        const std::string &order_by(const PlanStep &step) const {
+            return names_[step.order_by];
+        }
+
+        const std::vector<FieldPredicate> &filters(const PlanStep &step) const {
+            return filters_[step.filters];
+        }
+
+        //true when every filter on the step holds for the given fields
+        bool passes(const PlanStep &step, const std::unordered_map<std::string, PrimitiveFieldValue> &fields) const {
+            for (auto &filter : filters_[step.filters]) {
+                if (!filter.matches(fields)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //the reduction applied to a result slot, None for slots that hold every value
+        Aggregate aggregate(std::uint32_t slot) const {
+            return slot < aggregates_.size() ? aggregates_[slot] : Aggregate::None;
+        }
+
+        bool has_aggregates() const {
+            return std::any_of(aggregates_.begin(), aggregates_.end(), [](Aggregate a) {
+                return a != Aggregate::None;
+            });
+        }
+
+        const std::shared_ptr<const PathIndex> &index() const {
+            return index_;
+        }
+
+        //handle for the path at the given position in the paths the plan was built from
+        PathHandle handle(std::size_t path_ordinal) const {
+            return PathHandle{paths_[path_ordinal].slot};
+        }
+
+    private:
+        inline std::uint32_t intern(const std::string &name);
+
+        inline std::uint32_t intern(const std::vector<FieldPredicate> &filters);
+
+        inline void insert(const PlanPath &path, std::size_t path_idx);
+
+        std::vector<std::string> names_;
+        std::vector<std::vector<FieldPredicate>> filters_{{}};
+        std::vector<PlanPath> paths_;
+        std::vector<PlanNode> nodes_;
+        std::vector<std::size_t> roots_;
+        std::vector<Aggregate> aggregates_;
+        std::shared_ptr<const PathIndex> index_;
+    };
+
+    inline ViewPlan::ViewPlan(const std::vector<ViewPath> &paths) {
+        auto index = std::make_shared<PathIndex>();
+        paths_.reserve(paths.size());
+
+        for (auto &path : paths) {
+            if (path.empty()) {
+                throw std::invalid_argument{"view path must contain at least one element"};
+            }
+
+            PlanPath compiled{{}, path_to_string(path), 0};
+            compiled.steps.reserve(path.size());
+
+            for (ViewPath::size_type i = 0; i < path.size(); ++i) {
+                auto &elem = path[i];
+                auto last = i == path.size() - 1;
+
+                StepKind kind;
+                if (elem.is_val()) {
+                    kind = StepKind::Value;
+                } else if (elem.is_ref()) {
+                    kind = StepKind::Ref;
+                } else {
+                    kind = StepKind::ReverseRef;
+                }
+
+                if (last != (kind == StepKind::Value)) {
+                    throw std::invalid_argument{"view path " + compiled.key + " must end in exactly one value element"};
+                }
+
+                if ((elem.limit > 0 || elem.after > 0) && kind != StepKind::ReverseRef) {
+                    throw std::invalid_argument{"view path " + compiled.key + " pages a non reverse-ref element"};
+                }
+
+                if (elem.aggregate != Aggregate::None && !last) {
+                    throw std::invalid_argument{"view path " + compiled.key + " aggregates a non final element"};
+                }
+
+                if (elem.name.empty() && elem.aggregate != Aggregate::Count) {
+                    throw std::invalid_argument{"view path " + compiled.key + " has an unnamed element"};
+                }
+
+                if (elem.order != RefOrder::None && kind != StepKind::ReverseRef) {
+                    throw std::invalid_argument{"view path " + compiled.key + " orders a non reverse-ref element"};
+                }
+
+                auto by_field = elem.order == RefOrder::Highest || elem.order == RefOrder::Lowest;
+                if (by_field == elem.order_by.empty()) {
+                    throw std::invalid_argument{"view path " + compiled.key + " has an order_by that does not match its order"};
+                }
+
+                if (elem.repeat > 0 && (kind == StepKind::Value || elem.after > 0)) {
+                    throw std::invalid_argument{"view path " + compiled.key + " repeats a value or paged element"};
+                }
+
+                if (elem.order != RefOrder::None && elem.after > 0) {
+                    throw std::invalid_argument{"view path " + compiled.key + " resumes an ordered reverse ref"};
+                }
+
+                for (auto &filter : elem.filters) {
+                    if (filter.op == FieldPredicate::Op::Prefix && !filter.value.is_string()) {
+                        throw std::invalid_argument{"view path " + compiled.key + " has a non string prefix filter"};
+                    }
+                }
+
+                compiled.steps.push_back(PlanStep{intern(elem.name), elem.type, kind, elem.limit, elem.after,
+                                                  intern(elem.filters), elem.aggregate, elem.order,
+                                                  intern(elem.order_by), elem.repeat});
+            }
+
+            compiled.slot = index->add(compiled.key);
+            if (aggregates_.size() <= compiled.slot) {
+                aggregates_.resize(compiled.slot + 1, Aggregate::None);
+            }
+            aggregates_[compiled.slot] = compiled.steps.back().aggregate;
+            paths_.push_back(std::move(compiled));
+        }
+
+        index_ = std::move(index);
+
+        for (std::size_t i = 0; i < paths_.size(); ++i) {
+            insert(paths_[i], i);
+        }
+    }
+
+    inline void ViewPlan::insert(const PlanPath &path, std::size_t path_idx) {
+        //nodes_ may reallocate while inserting, so track the parent by index rather than holding its children
+        auto parent = nodes_.size();
+
+        for (auto &step : path.steps) {
+            auto &siblings = parent == nodes_.size() ? roots_ : nodes_[parent].children;
+            auto found = nodes_.size();
+
+            for (auto idx : siblings) {
+                auto &candidate = nodes_[idx].step;
+                if (candidate.same_hop(step)) {
+                    found = idx;
+                    break;
+                }
+            }
+
+            if (found == nodes_.size()) {
+                siblings.push_back(found);
+                nodes_.push_back(PlanNode{step, {}, path_idx, {}});
+            }
+
+            auto &slots = nodes_[found].slots;
+            if (std::find(slots.begin(), slots.end(), path.slot) == slots.end()) {
+                slots.push_back(path.slot);
+            }
+
+            parent = found;
+        }
+    }
+
+    inline std::uint32_t ViewPlan::intern(const std::string &name) {
+        for (std::uint32_t i = 0; i < names_.size(); ++i) {
+            if (names_[i] == name) {
+                return i;
+            }
+        }
+
+        names_.push_back(name);
+        return static_cast<std::uint32_t>(names_.size() - 1);
+    }
+
+    inline std::uint32_t ViewPlan::intern(const std::vector<FieldPredicate> &filters) {
+        for (std::uint32_t i = 0; i < filters_.size(); ++i) {
+            if (filters_[i] == filters) {
+                return i;
+            }
+        }
+
+        filters_.push_back(filters);
+        return static_cast<std::uint32_t>(filters_.size() - 1);
+    }
+
+
+    inline std::shared_ptr<const ViewPlan> make_view_plan(const std::vector<ViewPath> &paths) {
+        return std::make_shared<const ViewPlan>(paths);
+    }
+
+    /*
+     * Plans the paths that are valid on their own and leaves out the rest, so a malformed path in an ad-hoc
+     * descriptor only loses its own values, as it did before descriptors were planned.
+     */
+    inline std::shared_ptr<const ViewPlan> make_lenient_view_plan(const std::vector<ViewPath> &paths) {
+        try {
+            return make_view_plan(paths);
+        } catch (const std::invalid_argument &) {
+            std::vector<ViewPath> valid{};
+            for (auto &path : paths) {
+                try {
+                    ViewPlan{std::vector<ViewPath>{path}};
+                    valid.push_back(path);
+                } catch (const std::invalid_argument &) {
+                }
+            }
+            return make_view_plan(valid);
+        }
+    }
+
+    struct ViewPathsHash {
+        std::size_t operator()(const std::vector<ViewPath> &paths) const {
+            std::size_t h = 0;
+            for (auto &path : paths) {
+                for (auto &elem : path) {
+                    h = h * 31 + std::hash<PathElement>()(elem);
+                }
+                h = h * 31 + path.size();
+            }
+            return h;
+        }
+    };
+
+    inline ViewDescriptor plan_descriptor(std::shared_ptr<const ViewPlan> plan, EntityDescriptor root,
+                                          std::optional<ExpectedEntity> expectation = {}) {
+        return ViewDescriptor{root, {}, expectation, std::move(plan), {}, {}};
+    }
+
+}
+
+#endif //EVENTVIEW_VIEWPLAN_H